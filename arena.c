@@ -0,0 +1,114 @@
+/*
+ * arena.c
+ * bump-pointer arenas on top of the mm heap:
+ * 1) an arena owns a list of chunks, each one a single mm block;
+ * 2) allocation bumps a pointer through the current chunk and moves on to
+ *    the next chunk (or a new one) when it is used up;
+ * 3) reset keeps the chunks and rewinds to the first one, so it is O(1);
+ *    destroy hands every chunk back to mm in one pass.
+ */
+#include <stdio.h>
+
+#include "arena.h"
+#include "mm.h"
+
+#define ALIGNMENT 8
+#define ALIGN(p) (((size_t)(p) + (ALIGNMENT - 1)) & ~0x7)
+
+#define ARENA_CHUNKSIZE (1 << 16) /* Default chunk size (bytes) */
+
+/* A chunk header, the arena memory follows it */
+typedef struct chunk {
+  struct chunk *next; /* Next chunk, kept across resets */
+  size_t size;        /* Bytes of arena memory in this chunk */
+} chunk_t;
+
+#define CHUNK_DATA(c) ((char *)(c) + ALIGN(sizeof(chunk_t)))
+
+struct mm_arena {
+  chunk_t *head;    /* First chunk */
+  chunk_t *cur;     /* Chunk being bumped through */
+  char *ptr;        /* Next free byte in cur */
+  char *end;        /* End of cur */
+  size_t chunksize; /* Size of a regular chunk */
+};
+
+/*
+ * mm_arena_create - Create an empty arena, return NULL on error
+ */
+mm_arena_t *mm_arena_create(size_t chunksize) {
+  mm_arena_t *arena = mm_malloc(sizeof(mm_arena_t));
+  if (arena == NULL)
+    return NULL;
+  arena->head = arena->cur = NULL;
+  arena->ptr = arena->end = NULL;
+  arena->chunksize = chunksize ? ALIGN(chunksize) : ARENA_CHUNKSIZE;
+  return arena;
+}
+
+/*
+ * use_chunk - Start bumping through chunk c
+ */
+static void use_chunk(mm_arena_t *arena, chunk_t *c) {
+  arena->cur = c;
+  arena->ptr = CHUNK_DATA(c);
+  arena->end = CHUNK_DATA(c) + c->size;
+}
+
+/*
+ * mm_arena_alloc - Bump-allocate size bytes. When the current chunk is
+ *                  full, reuse the next retained chunk if it is big
+ *                  enough, otherwise link a new one in after the current.
+ */
+void *mm_arena_alloc(mm_arena_t *arena, size_t size) {
+  char *p;
+  chunk_t *c;
+
+  size = ALIGN(size);
+  if ((size_t)(arena->end - arena->ptr) < size) {
+    c = arena->cur ? arena->cur->next : arena->head;
+    if (c == NULL || c->size < size) {
+      size_t csize = size > arena->chunksize ? size : arena->chunksize;
+      if ((c = mm_malloc(ALIGN(sizeof(chunk_t)) + csize)) == NULL)
+        return NULL;
+      c->size = csize;
+      if (arena->cur) {
+        c->next = arena->cur->next;
+        arena->cur->next = c;
+      } else {
+        c->next = arena->head;
+        arena->head = c;
+      }
+    }
+    use_chunk(arena, c);
+  }
+  p = arena->ptr;
+  arena->ptr += size;
+  return p;
+}
+
+/*
+ * mm_arena_free - Nothing to do, the memory is reclaimed by reset
+ */
+void mm_arena_free(mm_arena_t *arena, void *ptr) {}
+
+/*
+ * mm_arena_reset - Release everything allocated from the arena at once
+ */
+void mm_arena_reset(mm_arena_t *arena) {
+  if (arena->head)
+    use_chunk(arena, arena->head);
+}
+
+/*
+ * mm_arena_destroy - Give all chunks and the arena itself back to mm
+ */
+void mm_arena_destroy(mm_arena_t *arena) {
+  chunk_t *c = arena->head;
+  while (c != NULL) {
+    chunk_t *next = c->next;
+    mm_free(c);
+    c = next;
+  }
+  mm_free(arena);
+}
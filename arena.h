@@ -0,0 +1,14 @@
+/*
+ * arena.h - bump-pointer arenas carved from the mm heap
+ */
+#include <stddef.h>
+
+typedef struct mm_arena mm_arena_t;
+
+/* Create an arena that grows in chunks of chunksize bytes (0: default) */
+extern mm_arena_t *mm_arena_create(size_t chunksize);
+extern void *mm_arena_alloc(mm_arena_t *arena, size_t size);
+/* Individual frees are no-ops, memory comes back on reset or destroy */
+extern void mm_arena_free(mm_arena_t *arena, void *ptr);
+extern void mm_arena_reset(mm_arena_t *arena);
+extern void mm_arena_destroy(mm_arena_t *arena);
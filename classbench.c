@@ -0,0 +1,145 @@
+/*
+ * classbench.c - Benchmark of mm_malloc_fast against mm_malloc.
+ *
+ * Each round mallocs a batch of blocks of one small size and frees them
+ * again: through mm_malloc and mm_free, through mm_malloc_fast and
+ * mm_free, and through mm_malloc_fast and mm_free_fast. With the size a
+ * constant, mm.h folds the fast calls into calls of mm_malloc_class and
+ * mm_free_class. The size is fixed at compile time by CB_SIZE, as it
+ * must be for the fast path to apply.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "memlib.h"
+#include "mm.h"
+
+#define CB_SIZE 40          /* Bytes of every request */
+#define CB_BATCH 1000       /* Blocks live at once */
+#define DEF_ROUNDS 3000     /* Default rounds (-n) */
+
+static void *blocks[CB_BATCH];
+
+static double now(void);
+static void usage(void);
+
+/*
+ * run_malloc - One round through mm_malloc; size is a parameter, so the
+ *              call cannot be resolved at compile time
+ */
+static __attribute__((noinline)) void run_malloc(size_t size)
+{
+    int i;
+
+    for (i = 0; i < CB_BATCH; i++)
+        blocks[i] = mm_malloc(size);
+    for (i = 0; i < CB_BATCH; i++)
+        mm_free(blocks[i]);
+}
+
+/*
+ * run_fast - One round through mm_malloc_fast with a constant size, and
+ *            mm_free_fast if sized is set
+ */
+static __attribute__((noinline)) void run_fast(int sized)
+{
+    int i;
+
+    for (i = 0; i < CB_BATCH; i++)
+        blocks[i] = mm_malloc_fast(CB_SIZE);
+    if (sized)
+        for (i = 0; i < CB_BATCH; i++)
+            mm_free_fast(blocks[i], CB_SIZE);
+    else
+        for (i = 0; i < CB_BATCH; i++)
+            mm_free(blocks[i]);
+}
+
+int main(int argc, char **argv)
+{
+    int c, r, rounds = DEF_ROUNDS, adaptive = 0, reserve = 0;
+    double t0, t1, t2, t3, ops;
+
+    while ((c = getopt(argc, argv, "n:arh")) != EOF) {
+        switch (c) {
+        case 'n': /* Rounds */
+            rounds = atoi(optarg);
+            break;
+        case 'a': /* Adaptive policies */
+            adaptive = 1;
+            break;
+        case 'r': /* A batch set aside first */
+            reserve = 1;
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (rounds < 1) {
+        usage();
+        exit(1);
+    }
+
+    mem_init();
+    if (mm_init() < 0) {
+        fprintf(stderr, "mm_init failed\n");
+        exit(1);
+    }
+    mm_set_adaptive(adaptive);
+    if (reserve && mm_reserve(CB_SIZE, CB_BATCH) < 0) {
+        fprintf(stderr, "mm_reserve failed\n");
+        exit(1);
+    }
+
+    t0 = now();
+    for (r = 0; r < rounds; r++)
+        run_malloc(CB_SIZE);
+    t1 = now();
+    for (r = 0; r < rounds; r++)
+        run_fast(0);
+    t2 = now();
+    for (r = 0; r < rounds; r++)
+        run_fast(1);
+    t3 = now();
+
+    ops = 2.0 * rounds * CB_BATCH;
+    printf("%d rounds of %d %d-byte mallocs and frees%s%s\n", rounds,
+           CB_BATCH, CB_SIZE, adaptive ? ", adaptive" : "",
+           reserve ? ", reserved" : "");
+    printf("mm_malloc, mm_free           %6.1f ns/op\n",
+           (t1 - t0) / ops * 1e9);
+    printf("mm_malloc_fast, mm_free      %6.1f ns/op\n",
+           (t2 - t1) / ops * 1e9);
+    printf("mm_malloc_fast, mm_free_fast %6.1f ns/op\n",
+           (t3 - t2) / ops * 1e9);
+    mem_deinit();
+    return 0;
+}
+
+/*
+ * now - Seconds on the monotonic clock
+ */
+static double now(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: classbench [-arh] [-n <rounds>]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-n <n>     Rounds of each kind (default %d).\n",
+            DEF_ROUNDS);
+    fprintf(stderr, "\t-a         Turn the adaptive policies on.\n");
+    fprintf(stderr, "\t-r         Set a batch of blocks aside first.\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+}
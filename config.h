@@ -149,6 +149,12 @@
  */
 #define MAX_HEAP (100*(1<<20))  /* 100 MB */
 
+/*
+ * Size of a transparent huge page, used when the heap is backed by
+ * huge pages (mdriver -H)
+ */
+#define HUGEPAGE_SIZE (1<<21)  /* 2 MB */
+
 /*****************************************************************************
  * Set exactly one of these USE_xxx constants to "1" to select a timing method
  *****************************************************************************/
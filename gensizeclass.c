@@ -0,0 +1,224 @@
+/*
+ * gensizeclass.c - Derive allocator size classes from malloc lab traces.
+ *
+ * Reads the alloc and realloc requests of one or more trace files (the
+ * format read by mdriver's read_trace) and picks the class boundaries
+ * that minimize the total bytes lost to rounding each request up to its
+ * class, for a given number of classes. The result is written as a
+ * header with a class size table and a size-to-class lookup table.
+ *
+ * The boundaries are found by dynamic programming over the request
+ * sizes seen in the traces, in units of ALIGNMENT bytes: waste[k][j] is
+ * the least waste of covering the sizes up to candidate j with k classes,
+ * the last of which is j.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define ALIGNMENT 8         /* Class sizes are multiples of this */
+#define MAXLINE 1024        /* Max trace line and file name length */
+#define DEF_CLASSES 32      /* Default number of classes (-n) */
+#define DEF_MAXSIZE 4096    /* Default largest class size in bytes (-m) */
+
+static double *count;       /* Requests of each size, in ALIGNMENT units */
+static int ngran;           /* Number of ALIGNMENT units up to maxsize */
+
+static void read_sizes(const char *filename);
+static void usage(void);
+
+int main(int argc, char **argv)
+{
+    int nclasses = DEF_CLASSES, maxsize = DEF_MAXSIZE;
+    char *outname = NULL;
+    FILE *out = stdout;
+    int c, i, j, k, m, *cand, *from, *bound;
+    double *W, *S, *waste, total = 0;
+
+    while ((c = getopt(argc, argv, "n:m:o:h")) != EOF) {
+        switch (c) {
+        case 'n': /* Number of classes */
+            nclasses = atoi(optarg);
+            break;
+        case 'm': /* Largest class size */
+            maxsize = atoi(optarg);
+            break;
+        case 'o': /* Output header */
+            outname = optarg;
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (optind == argc || nclasses < 1 || maxsize < ALIGNMENT) {
+        usage();
+        exit(1);
+    }
+
+    ngran = maxsize / ALIGNMENT;
+    if ((count = calloc(ngran + 1, sizeof(double))) == NULL) {
+        perror("calloc");
+        exit(1);
+    }
+    for (i = optind; i < argc; i++)
+        read_sizes(argv[i]);
+
+    /* candidate class sizes: every size seen, and always the largest */
+    if ((cand = malloc((ngran + 1) * sizeof(int))) == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    m = 0;
+    cand[m++] = 0;
+    for (j = 1; j <= ngran; j++)
+        if (count[j] > 0 || j == ngran)
+            cand[m++] = j;
+    if (nclasses > m - 1)
+        nclasses = m - 1;
+
+    /* prefix sums give the waste of one class in O(1) */
+    W = calloc(ngran + 1, sizeof(double));
+    S = calloc(ngran + 1, sizeof(double));
+    waste = malloc((size_t)(nclasses + 1) * m * sizeof(double));
+    from = malloc((size_t)(nclasses + 1) * m * sizeof(int));
+    bound = malloc((nclasses + 1) * sizeof(int));
+    if (!W || !S || !waste || !from || !bound) {
+        perror("malloc");
+        exit(1);
+    }
+    for (j = 1; j <= ngran; j++) {
+        W[j] = W[j-1] + count[j];
+        S[j] = S[j-1] + count[j] * j;
+    }
+#define WASTE(a, b) (((b) * (W[b] - W[a]) - (S[b] - S[a])) * ALIGNMENT)
+#define AT(k, j) ((size_t)(k) * m + (j))
+
+    for (j = 0; j < m; j++)
+        waste[AT(0, j)] = j == 0 ? 0 : -1;
+    for (k = 1; k <= nclasses; k++) {
+        for (j = 0; j < m; j++) {
+            waste[AT(k, j)] = -1;
+            for (i = k - 1; i < j; i++) {
+                double w;
+                if (waste[AT(k-1, i)] < 0)
+                    continue;
+                w = waste[AT(k-1, i)] + WASTE(cand[i], cand[j]);
+                if (waste[AT(k, j)] < 0 || w < waste[AT(k, j)]) {
+                    waste[AT(k, j)] = w;
+                    from[AT(k, j)] = i;
+                }
+            }
+        }
+    }
+
+    /* walk back from the largest size */
+    for (k = nclasses, j = m - 1; k > 0; k--) {
+        bound[k] = cand[j];
+        j = from[AT(k, j)];
+    }
+    for (j = 1; j <= ngran; j++)
+        total += count[j];
+
+    if (outname && (out = fopen(outname, "w")) == NULL) {
+        fprintf(stderr, "Could not open %s: %s\n", outname, strerror(errno));
+        exit(1);
+    }
+    fprintf(out, "/*\n * sizeclass.h - Size classes generated by gensizeclass"
+            " from %d trace(s).\n", argc - optind);
+    fprintf(out, " * %.0f requests up to %d bytes, %.0f bytes (%.1f per"
+            " request) lost to rounding.\n", total, maxsize,
+            waste[AT(nclasses, m - 1)],
+            total ? waste[AT(nclasses, m - 1)] / total : 0);
+    fprintf(out, " * Do not edit; rerun \"make sizeclass\" instead.\n */\n");
+    fprintf(out, "#ifndef __SIZECLASS_H_\n#define __SIZECLASS_H_\n\n");
+    fprintf(out, "#define SC_NCLASSES %d\n", nclasses);
+    fprintf(out, "#define SC_MAXSIZE %d\n\n", bound[nclasses] * ALIGNMENT);
+    fprintf(out, "/* Payload bytes of each class */\n");
+    fprintf(out, "static const unsigned int sc_size[SC_NCLASSES] = {");
+    for (k = 1; k <= nclasses; k++)
+        fprintf(out, "%s%d%s", (k - 1) % 8 ? " " : "\n    ",
+                bound[k] * ALIGNMENT, k < nclasses ? "," : "\n};\n\n");
+    fprintf(out, "/* Class of each size, indexed by size in %d byte units,"
+            " rounded up */\n", ALIGNMENT);
+    fprintf(out, "static const unsigned char sc_index[SC_MAXSIZE / %d + 1]"
+            " = {", ALIGNMENT);
+    for (j = 0, k = 1; j <= bound[nclasses]; j++) {
+        while (bound[k] < j)
+            k++;
+        fprintf(out, "%s%d%s", j % 16 ? " " : "\n    ", k - 1,
+                j < bound[nclasses] ? "," : "\n};\n\n");
+    }
+    fprintf(out, "/*\n * sc_class - Class of a request of size bytes,"
+            " 0 < size <= SC_MAXSIZE.\n"
+            " *     Folds to a constant when size is a constant.\n */\n");
+    fprintf(out, "static inline unsigned int sc_class(unsigned long size) {\n"
+            "    return sc_index[(size + %d) / %d];\n}\n\n",
+            ALIGNMENT - 1, ALIGNMENT);
+    fprintf(out, "#endif /* __SIZECLASS_H_ */\n");
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
+
+/*
+ * read_sizes - Count the alloc and realloc sizes of one trace file that
+ *     are at most maxsize bytes
+ */
+static void read_sizes(const char *filename)
+{
+    FILE *tracefile;
+    char type[MAXLINE];
+    int weight, num_ids, num_ops, ignore_ranges;
+    unsigned int index, size;
+
+    if ((tracefile = fopen(filename, "r")) == NULL) {
+        fprintf(stderr, "Could not open %s: %s\n", filename, strerror(errno));
+        exit(1);
+    }
+    if (fscanf(tracefile, "%d %d %d %d", &weight, &num_ids, &num_ops,
+               &ignore_ranges) != 4) {
+        fprintf(stderr, "%s: bad trace header\n", filename);
+        exit(1);
+    }
+    while (num_ops-- > 0 && fscanf(tracefile, "%s", type) == 1) {
+        switch (type[0]) {
+        case 'a':
+        case 'r':
+            if (fscanf(tracefile, "%u %u", &index, &size) != 2)
+                break;
+            if (size > 0 && size <= (unsigned)ngran * ALIGNMENT)
+                count[(size + ALIGNMENT - 1) / ALIGNMENT]++;
+            break;
+        case 'f':
+            fscanf(tracefile, "%u", &index);
+            break;
+        default:
+            fprintf(stderr, "%s: bogus type character (%c)\n", filename,
+                    type[0]);
+            exit(1);
+        }
+    }
+    fclose(tracefile);
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: gensizeclass [-n <classes>] [-m <maxsize>]"
+            " [-o <file>] <trace>...\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-n <n>     Number of size classes (default %d).\n",
+            DEF_CLASSES);
+    fprintf(stderr, "\t-m <n>     Largest class size in bytes (default %d).\n",
+            DEF_MAXSIZE);
+    fprintf(stderr, "\t-o <file>  Write the header to <file> instead of"
+            " stdout.\n");
+}
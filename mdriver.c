@@ -23,6 +23,8 @@
 #include "mm.h"
 #include "memlib.h"
 #include "fsecs.h"
+#include "clock.h"
+#include "perfctr.h"
 #include "config.h"
 
 /**********************
@@ -31,6 +33,8 @@
 
 /* Misc */
 #define MAXLINE     1024 /* max string size */
+#define COMPACT_INTERVAL  32 /* requests between compactions with -m */
+#define COMPACT_MOVES     64 /* blocks moved per compaction with -m */
 #define HDRLINES       4 /* number of header lines in a trace file */
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
 
@@ -67,6 +71,7 @@ typedef struct {
     enum { ALLOC, FREE, REALLOC } type; /* type of request */
     int index;                        /* index for free() to use later */
     size_t size;                      /* byte size of alloc/realloc request */
+    int hint;                         /* lifetime hint of alloc, 0 if none */
 } traceop_t;
 
 /* Holds the information for one trace file*/
@@ -106,6 +111,17 @@ typedef struct {
     /* defined only for the student malloc package */
     double util;     /* space utilization for this trace (always 0 for libc) */
 
+    /* defined only if the driver reports resident memory (-r) */
+    double heapsize;   /* heap size in bytes at the end of the trace */
+    double rss_base;   /* resident heap bytes without scavenging */
+    double rss;        /* resident heap bytes with scavenging */
+
+    /* defined only if the driver tries movable handles (-m) */
+    double hutil;      /* space utilization with handles and compaction */
+
+    /* defined only if the driver measures request latency (-L) */
+    double lat[4];     /* p50, p99, p99.9 and max cycles of one request */
+
     /* Note: secs and util are only defined if valid is true */
 } stats_t;
 
@@ -140,6 +156,15 @@ static enum { DBG_NONE, DBG_CHEAP, DBG_EXPENSIVE } debug_mode = DBG_CHEAP;
 int verbose = 1;        /* global flag for verbose output */
 static int errors = 0;  /* number of errs found when running student malloc */
 int onetime_flag = 0;
+static int rss_flag = 0; /* report resident heap memory (-r) */
+static int huge_flag = 0; /* compare normal and huge pages (-H) */
+static int nohint_flag = 0; /* ignore lifetime hints in traces (-n) */
+static int pageheap_flag = 0; /* serve mid-sized requests from spans (-P) */
+static int linealign_flag = 0; /* align requests to cache lines (-C) */
+static int widecopy_flag = 1; /* copy moved blocks wide, not memcpy (-M) */
+static int adaptive_flag = 0; /* pick policies by workload phase (-a) */
+static int handle_flag = 0; /* measure util with movable handles (-m) */
+static int latency_flag = 0; /* report per-request latency (-L) */
 
 /* by default, no timeouts */
 static int set_timeout = 0;
@@ -187,10 +212,19 @@ static void eval_libc_speed(void *ptr);
    of the student's malloc package in mm.c */
 static int eval_mm_valid(trace_t *trace, range_t **ranges);
 static double eval_mm_util(trace_t *trace, int tracenum);
+static void eval_mm_rss(trace_t *trace, int tracenum, stats_t *stats);
+static double eval_mm_hutil(trace_t *trace, int tracenum);
+static void hfill(mm_handle_t h, int index, int size);
+static void hcheck(mm_handle_t h, int index, int size, int tracenum, int opnum);
 static void eval_mm_speed(void *ptr);
+static void eval_mm_latency(trace_t *trace, stats_t *stats);
+static char *mm_malloc_op(const traceop_t *op);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats, sum_stats_t *sumstats);
+static void printrss(int n, stats_t *stats);
+static void printhutil(int n, stats_t *stats);
+static void printlatency(int n, stats_t *stats);
 static void usage(void);
 static void malloc_error(const trace_t *trace, int opnum, const char *fmt, ...)
     __attribute__((format(printf, 3,4)));
@@ -246,6 +280,12 @@ static void run_tests(int num_tracefiles, const char *tracedir,
             if (verbose > 1)
                 printf("efficiency, ");
             mm_stats[i].util = eval_mm_util(trace, i);
+            if (rss_flag)
+                eval_mm_rss(trace, i, &mm_stats[i]);
+            if (handle_flag)
+                mm_stats[i].hutil = eval_mm_hutil(trace, i);
+            if (latency_flag)
+                eval_mm_latency(trace, &mm_stats[i]);
             speed_params->trace = trace;
             speed_params->ranges = ranges;
             if (verbose > 1)
@@ -260,6 +300,54 @@ static void run_tests(int num_tracefiles, const char *tracedir,
     }
 }
 
+/*
+ * run_hugepage_tests - Time each trace with the heap on normal pages and
+ *   on transparent huge pages, and count the data TLB misses of one run
+ *   in each configuration.
+ */
+static void run_hugepage_tests(int num_tracefiles, const char *tracedir,
+                               char **tracefiles, stats_t *mm_stats,
+                               speed_t *speed_params) {
+    int i, huge;
+    double secs[2];
+    long long misses[2];
+    stats_t stats;
+    int fd = perfctr_open_dtlb();
+
+    printf("Normal vs huge pages (%s):\n",
+           fd < 0 ? "no dTLB counter on this machine" : "dTLB load misses");
+    printf("%9s%12s%9s%12s  %s\n",
+           "4K Kops", "4K misses", "2M Kops", "2M misses", "trace");
+    for (i=0; i < num_tracefiles; i++) {
+        /* only traces that count for throughput are worth timing */
+        if (!mm_stats[i].valid || mm_stats[i].weight == WUTIL)
+            continue;
+
+        trace_t *trace = read_trace(&stats, tracedir, tracefiles[i]);
+        speed_params->trace = trace;
+        for (huge = 0; huge < 2; huge++) {
+            mem_set_hugepages(huge);
+            mem_init();
+            secs[huge] = fsecs(eval_mm_speed, speed_params);
+            perfctr_start(fd);
+            eval_mm_speed(speed_params);
+            misses[huge] = perfctr_stop(fd);
+            mem_deinit();
+        }
+        for (huge = 0; huge < 2; huge++) {
+            printf("%9.0f", (stats.ops/1e3)/secs[huge]);
+            if (misses[huge] < 0)
+                printf("%12s", "-");
+            else
+                printf("%12lld", misses[huge]);
+        }
+        printf("  %s\n", trace->filename);
+        free_trace(trace);
+    }
+    mem_set_hugepages(0);
+    perfctr_close(fd);
+}
+
 /**************
  * Main routine
  **************/
@@ -291,7 +379,7 @@ int main(int argc, char **argv)
     /*
      * Read and interpret the command line arguments
      */
-    while ((c = getopt(argc, argv, "d:f:c:s:t:v:hpVAlD")) != EOF) {
+    while ((c = getopt(argc, argv, "d:f:c:s:t:v:hpVAlDrHnmLPCMa")) != EOF) {
         switch (c) {
 
         case 'A': /* Hidden Autolab driver argument */
@@ -332,6 +420,42 @@ int main(int argc, char **argv)
             run_libc = 1;
             break;
 
+        case 'r': /* Report resident heap memory */
+            rss_flag = 1;
+            break;
+
+        case 'H': /* Compare normal and huge pages */
+            huge_flag = 1;
+            break;
+
+        case 'n': /* Ignore lifetime hints */
+            nohint_flag = 1;
+            break;
+
+        case 'm': /* Measure utilization with movable handles */
+            handle_flag = 1;
+            break;
+
+        case 'L': /* Report per-request latency */
+            latency_flag = 1;
+            break;
+
+        case 'P': /* Use the page heap of mm.c */
+            pageheap_flag = 1;
+            break;
+
+        case 'C': /* Align to cache lines */
+            linealign_flag = 1;
+            break;
+
+        case 'M': /* Copy moved blocks with plain memcpy */
+            widecopy_flag = 0;
+            break;
+
+        case 'a': /* Pick policies by workload phase */
+            adaptive_flag = 1;
+            break;
+
         case 'V': /* Increase verbosity level */
             verbose += 1;
             break;
@@ -375,6 +499,12 @@ int main(int argc, char **argv)
     /* Initialize the timing package */
     init_fsecs();
 
+    /* Kept by mm across mm_init calls */
+    mm_set_pageheap(pageheap_flag);
+    mm_set_linealign(linealign_flag);
+    mm_set_widecopy(widecopy_flag);
+    mm_set_adaptive(adaptive_flag);
+
     /* Initialize the timeout */
     if (set_timeout > 0) {
         signal(SIGALRM, timeout_handler);
@@ -445,6 +575,23 @@ int main(int argc, char **argv)
             printf("\nResults for mm malloc:\n");
             printresults(num_tracefiles, mm_stats, &global_mm_sum_stats);
             printf("\n");
+            if (rss_flag) {
+                printrss(num_tracefiles, mm_stats);
+                printf("\n");
+            }
+            if (handle_flag) {
+                printhutil(num_tracefiles, mm_stats);
+                printf("\n");
+            }
+            if (latency_flag) {
+                printlatency(num_tracefiles, mm_stats);
+                printf("\n");
+            }
+            if (huge_flag) {
+                run_hugepage_tests(num_tracefiles, tracedir, tracefiles,
+                                   mm_stats, &speed_params);
+                printf("\n");
+            }
         }
     }
 
@@ -810,10 +957,13 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
     while (fscanf(tracefile, "%s", type) != EOF) {
         switch(type[0]) {
         case 'a':
+            /* "as" and "al" carry a short- or long-lived hint */
             fscanf(tracefile, "%u %u", &index, &size);
             trace->ops[op_index].type = ALLOC;
             trace->ops[op_index].index = index;
             trace->ops[op_index].size = size;
+            trace->ops[op_index].hint = type[1] == 's' ? MM_SHORT_LIVED :
+                                        type[1] == 'l' ? MM_LONG_LIVED : 0;
             max_index = (index > max_index) ? index : max_index;
             break;
         case 'r':
@@ -922,7 +1072,7 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
         case ALLOC: /* mm_malloc */
 
             /* Call the student's malloc */
-            if ((p = mm_malloc(size)) == NULL) {
+            if ((p = mm_malloc_op(&trace->ops[i])) == NULL) {
                 malloc_error(trace, i, "mm_malloc failed.");
                 return 0;
             }
@@ -1011,10 +1161,10 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
  *   The idea is to remember the high water mark "hwm" of the heap for
  *   an optimal allocator, i.e., no gaps and no internal fragmentation.
  *   Utilization is the ratio hwm/heapsize, where heapsize is the
- *   size of the heap in bytes after running the student's malloc
- *   package on the trace. Note that our implementation of mem_sbrk()
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap.
+ *   largest size of the heap in bytes while running the student's malloc
+ *   package on the trace. mem_sbrk() may shrink the heap, so memlib
+ *   keeps the high water mark of brk for us. Metadata a package keeps
+ *   outside that heap (mm_meta_peak) counts as heap too.
  *
  *   A higher number is better: 1 is optimal.
  */
@@ -1042,7 +1192,7 @@ static double eval_mm_util(trace_t *trace, int tracenum)
             index = trace->ops[i].index;
             size = trace->ops[i].size;
 
-            if ((p = mm_malloc(size)) == NULL) {
+            if ((p = mm_malloc_op(&trace->ops[i])) == NULL) {
                 app_error("trace %d: mm_malloc failed in eval_mm_util",
                           tracenum);
             }
@@ -1099,9 +1249,159 @@ static double eval_mm_util(trace_t *trace, int tracenum)
 
     printf(".");
 
-    return ((double)max_total_size / (double)mem_heapsize());
+    return ((double)max_total_size /
+            (double)(mem_heappeak() + mm_meta_peak()));
+}
+
+/*
+ * hfill - Fill the first size bytes of the block behind handle h with a
+ *   pattern of its index
+ */
+static void hfill(mm_handle_t h, int index, int size)
+{
+    unsigned char *p = mm_hlock(h);
+    int j;
+
+    for (j = 0; j < size; j++)
+        p[j] = (unsigned char)(index + j);
+    mm_hunlock(h);
 }
 
+/*
+ * hcheck - Check that the block behind handle h still holds the pattern
+ *   of hfill in its first size bytes, wherever compaction moved it
+ */
+static void hcheck(mm_handle_t h, int index, int size, int tracenum, int opnum)
+{
+    unsigned char *p = mm_hlock(h);
+    int j;
+
+    for (j = 0; j < size; j++)
+        if (p[j] != (unsigned char)(index + j))
+            app_error("trace %d, op %d: block %d garbled at byte %d "
+                      "in eval_mm_hutil", tracenum, opnum, index, j);
+    mm_hunlock(h);
+}
+
+/*
+ * eval_mm_hutil - Evaluate the space utilization like eval_mm_util,
+ *   but keep every block behind a movable handle and let the package
+ *   compact the heap every COMPACT_INTERVAL requests. Payloads are
+ *   filled and checked like in eval_mm_valid, so that blocks keep
+ *   their contents when they move.
+ */
+static double eval_mm_hutil(trace_t *trace, int tracenum)
+{
+    int i;
+    int index;
+    int size, newsize, oldsize;
+    int max_total_size = 0;
+    int total_size = 0;
+    mm_handle_t *handles;
+
+    if ((handles = calloc(trace->num_ids, sizeof(mm_handle_t))) == NULL)
+        unix_error("calloc failed in eval_mm_hutil");
+    reinit_trace(trace);
+
+    /* initialize the heap and the mm malloc package */
+    mem_reset_brk();
+    if (mm_init() < 0)
+        app_error("trace %d: mm_init failed in eval_mm_hutil", tracenum);
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+        index = trace->ops[i].index;
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* mm_halloc */
+            size = trace->ops[i].size;
+            if ((handles[index] = mm_halloc(size)) == 0)
+                app_error("trace %d: mm_halloc failed in eval_mm_hutil",
+                          tracenum);
+            hfill(handles[index], index, size);
+            trace->block_sizes[index] = size;
+            total_size += size;
+            break;
+
+        case REALLOC: /* mm_hrealloc */
+            newsize = trace->ops[i].size;
+            oldsize = trace->block_sizes[index];
+            if (handles[index] != 0)
+                hcheck(handles[index], index, oldsize, tracenum, i);
+            if (newsize == 0) {
+                mm_hfree(handles[index]);
+                handles[index] = 0;
+            } else if (handles[index] == 0) {
+                if ((handles[index] = mm_halloc(newsize)) == 0)
+                    app_error("trace %d: mm_halloc failed in eval_mm_hutil",
+                              tracenum);
+            } else if (mm_hrealloc(handles[index], newsize) < 0) {
+                app_error("trace %d: mm_hrealloc failed in eval_mm_hutil",
+                          tracenum);
+            } else {
+                /* the old bytes must have come along */
+                hcheck(handles[index], index,
+                       oldsize < newsize ? oldsize : newsize, tracenum, i);
+            }
+            if (handles[index] != 0)
+                hfill(handles[index], index, newsize);
+            trace->block_sizes[index] = newsize;
+            total_size += (newsize - oldsize);
+            break;
+
+        case FREE: /* mm_hfree */
+            if (index >= 0) {
+                hcheck(handles[index], index, trace->block_sizes[index],
+                       tracenum, i);
+                mm_hfree(handles[index]);
+                handles[index] = 0;
+                total_size -= trace->block_sizes[index];
+            }
+            break;
+
+        default:
+            app_error("trace %d: Nonexistent request type in eval_mm_hutil",
+                      tracenum);
+        }
+
+        if (i % COMPACT_INTERVAL == 0)
+            mm_compact(COMPACT_MOVES);
+
+        /* update the high-water mark */
+        max_total_size = (total_size > max_total_size) ?
+            total_size : max_total_size;
+    }
+
+    /* the blocks that were never freed have moved the most */
+    for (index = 0; index < trace->num_ids; index++)
+        if (handles[index] != 0)
+            hcheck(handles[index], index, trace->block_sizes[index],
+                   tracenum, trace->num_ops);
+    free(handles);
+    printf(".");
+
+    return ((double)max_total_size /
+            (double)(mem_heappeak() + mm_meta_peak()));
+}
+
+/*
+ * eval_mm_rss - Measure how much of the heap is backed by physical
+ *   pages at the end of the trace, once with the scavenger off and once
+ *   with it on. Pages left over from earlier runs are dropped first so
+ *   that each run starts from an empty resident set.
+ */
+static void eval_mm_rss(trace_t *trace, int tracenum, stats_t *stats)
+{
+    mem_release(mem_heap_lo(), mem_heapsize());
+    mm_set_scavenge(0);
+    eval_mm_util(trace, tracenum);
+    stats->rss_base = mem_resident();
+
+    mem_release(mem_heap_lo(), mem_heapsize());
+    mm_set_scavenge(1);
+    eval_mm_util(trace, tracenum);
+    stats->rss = mem_resident();
+    stats->heapsize = mem_heapsize();
+}
 
 /*
  * eval_mm_speed - This is the function that is used by fcyc()
@@ -1109,7 +1409,7 @@ static double eval_mm_util(trace_t *trace, int tracenum)
  */
 static void eval_mm_speed(void *ptr)
 {
-    int i, index, size, newsize;
+    int i, index, newsize;
     char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
     reinit_trace(trace);
@@ -1125,8 +1425,7 @@ static void eval_mm_speed(void *ptr)
 
         case ALLOC: /* mm_malloc */
             index = trace->ops[i].index;
-            size = trace->ops[i].size;
-            if ((p = mm_malloc(size)) == NULL)
+            if ((p = mm_malloc_op(&trace->ops[i])) == NULL)
                 app_error("mm_malloc error in eval_mm_speed");
             trace->blocks[index] = p;
             break;
@@ -1155,6 +1454,91 @@ static void eval_mm_speed(void *ptr)
         }
 }
 
+/*
+ * cmp_double - qsort comparator for ascending doubles
+ */
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * eval_mm_latency - Time every request of the trace on its own with the
+ *   cycle counter and record the median, the tail percentiles and the
+ *   worst case. The trace is run once untimed first so that the heap
+ *   pages are faulted in and the timed run sees the allocator alone.
+ */
+static void eval_mm_latency(trace_t *trace, stats_t *stats)
+{
+    int i, index, n = trace->num_ops;
+    char *p;
+    double *cycles;
+    speed_t params;
+
+    if ((cycles = malloc(n * sizeof(double))) == NULL)
+        unix_error("malloc failed in eval_mm_latency");
+    params.trace = trace;
+    eval_mm_speed(&params);
+
+    reinit_trace(trace);
+    mem_reset_brk();
+    if (mm_init() < 0)
+        app_error("mm_init failed in eval_mm_latency");
+
+    for (i = 0;  i < n;  i++) {
+        index = trace->ops[i].index;
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* mm_malloc */
+            start_counter();
+            p = mm_malloc_op(&trace->ops[i]);
+            cycles[i] = get_counter();
+            if (p == NULL)
+                app_error("mm_malloc error in eval_mm_latency");
+            trace->blocks[index] = p;
+            break;
+
+        case REALLOC: /* mm_realloc */
+            start_counter();
+            p = mm_realloc(trace->blocks[index], trace->ops[i].size);
+            cycles[i] = get_counter();
+            if (p == NULL && trace->ops[i].size != 0)
+                app_error("mm_realloc error in eval_mm_latency");
+            trace->blocks[index] = p;
+            break;
+
+        case FREE: /* mm_free */
+            p = index < 0 ? NULL : trace->blocks[index];
+            start_counter();
+            mm_free(p);
+            cycles[i] = get_counter();
+            break;
+
+        default:
+            app_error("Nonexistent request type in eval_mm_latency");
+        }
+    }
+
+    qsort(cycles, n, sizeof(double), cmp_double);
+    stats->lat[0] = cycles[(int)(n * 0.5)];
+    stats->lat[1] = cycles[(int)(n * 0.99)];
+    stats->lat[2] = cycles[(int)(n * 0.999)];
+    stats->lat[3] = cycles[n - 1];
+    free(cycles);
+}
+
+/*
+ * mm_malloc_op - Serve an alloc request, passing its lifetime hint on to
+ *    mm_malloc_hint unless hints are ignored
+ */
+static char *mm_malloc_op(const traceop_t *op)
+{
+    if (op->hint && !nohint_flag)
+        return mm_malloc_hint(op->size, op->hint);
+    return mm_malloc(op->size);
+}
+
 /*
  * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
@@ -1383,6 +1767,74 @@ static void printresults(int n, stats_t *stats, sum_stats_t *sumstats)
     }
 }
 
+/*
+ * printrss - prints the resident heap memory of each trace with and
+ *            without the scavenger, in KB
+ */
+static void printrss(int n, stats_t *stats)
+{
+    int i;
+    double sumbase = 0;
+    double sumrss = 0;
+
+    printf("Resident heap (KB):\n");
+    printf("%9s%9s%9s%7s  %s\n", "heap", "noscav", "scav", "saved", "trace");
+    for (i=0; i < n; i++) {
+        if (!stats[i].valid)
+            continue;
+        printf("%9.0f%9.0f%9.0f%6.0f%% %s\n",
+               stats[i].heapsize / 1024,
+               stats[i].rss_base / 1024,
+               stats[i].rss / 1024,
+               stats[i].rss_base == 0 ? 0 :
+               (1 - stats[i].rss / stats[i].rss_base) * 100.0,
+               stats[i].filename);
+        sumbase += stats[i].rss_base;
+        sumrss += stats[i].rss;
+    }
+    printf("%9s%9.0f%9.0f%6.0f%%\n", "",
+           sumbase / 1024, sumrss / 1024,
+           sumbase == 0 ? 0 : (1 - sumrss / sumbase) * 100.0);
+}
+
+/*
+ * printhutil - prints the space utilization of each trace with plain
+ *              blocks and with movable handles
+ */
+static void printhutil(int n, stats_t *stats)
+{
+    int i;
+
+    printf("Utilization with movable handles:\n");
+    printf("%6s%7s  %s\n", "util", "hutil", "trace");
+    for (i=0; i < n; i++) {
+        if (!stats[i].valid)
+            continue;
+        printf("%5.0f%%%6.0f%%  %s\n",
+               stats[i].util * 100.0, stats[i].hutil * 100.0,
+               stats[i].filename);
+    }
+}
+
+/*
+ * printlatency - prints the latency percentiles of one request in each
+ *                trace, in cycles
+ */
+static void printlatency(int n, stats_t *stats)
+{
+    int i;
+
+    printf("Request latency (cycles):\n");
+    printf("%8s%8s%8s%10s  %s\n", "p50", "p99", "p99.9", "max", "trace");
+    for (i=0; i < n; i++) {
+        if (!stats[i].valid)
+            continue;
+        printf("%8.0f%8.0f%8.0f%10.0f  %s\n",
+               stats[i].lat[0], stats[i].lat[1], stats[i].lat[2],
+               stats[i].lat[3], stats[i].filename);
+    }
+}
+
 /*
  * app_error - Report an arbitrary application error
  */
@@ -1428,7 +1880,7 @@ void malloc_error(const trace_t *trace, int opnum, const char *fmt, ...)
  */
 static void usage(void)
 {
-    fprintf(stderr, "Usage: mdriver [-hlVdD] [-f <file>]\n");
+    fprintf(stderr, "Usage: mdriver [-hlrHnmLPCMVdD] [-f <file>]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-p         Calculate Checkpoint Score.\n");
     fprintf(stderr, "\t-d <i>     Debug: 0 off; 1 default; 2 lots.\n");
@@ -1437,6 +1889,15 @@ static void usage(void)
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-r         Report resident heap memory with and without scavenging.\n");
+    fprintf(stderr, "\t-H         Compare throughput and dTLB misses on normal and huge pages.\n");
+    fprintf(stderr, "\t-n         Ignore lifetime hints (as/al requests) in traces.\n");
+    fprintf(stderr, "\t-m         Report utilization with movable handles and compaction.\n");
+    fprintf(stderr, "\t-L         Report p50/p99/p99.9/max cycles of one request.\n");
+    fprintf(stderr, "\t-P         Serve 1 KB to 256 KB requests from page spans.\n");
+    fprintf(stderr, "\t-C         Align requests of 64 bytes or more to cache lines.\n");
+    fprintf(stderr, "\t-M         Copy blocks moved by realloc with plain memcpy.\n");
+    fprintf(stderr, "\t-a         Pick placement policies by workload phase.\n");
     fprintf(stderr, "\t-V         Print diagnostics as each trace is run.\n");
     fprintf(stderr, "\t-v <i>     Set Verbosity Level to <i>\n");
     fprintf(stderr, "\t-s <s>     Timeout after s secs (default no timeout)\n");
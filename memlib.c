@@ -3,6 +3,7 @@
  *						allows us to interleave calls from the student's malloc package 
  *						with the system's malloc package in libc.
  */
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -12,83 +13,444 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
 
 #include "memlib.h"
 #include "config.h"
 
+/* one simulated heap, with its own mapping and brk */
+struct mem_region {
+	char *heap;				/* first byte of the heap */
+	char *brk;				/* first byte past the heap */
+	char *peak_brk;			/* high water mark of brk */
+	char *max_addr;			/* largest legal brk */
+	char *map;				/* mapping that holds the heap */
+	size_t map_len;
+	int huge;				/* heap is backed by huge pages */
+	int fd;					/* file holding the heap, -1 if none */
+	int lock_fd;			/* file or object mem_region_lock locks */
+	struct mem_shared *shared;	/* brk of a heap in shared memory */
+};
+
+/* head of a heap in shared memory, in the page in front of it. Each
+ * process maps the heap at an address of its own, so it keeps offsets */
+#define MEM_SHARED_MAGIC 0x6d656d73
+#define MEM_SHM_WAIT 1000		/* ms an attaching process waits for the maker */
+struct mem_shared {
+	unsigned int magic;		/* MEM_SHARED_MAGIC once set up */
+	size_t brk;				/* heap bytes in use */
+	size_t peak;			/* high water mark of brk */
+};
+
 /* private variables */
-static char *heap;
-static char *mem_brk;
-static char *mem_max_addr;
+static mem_region_t mem_default;	/* the region behind mem_sbrk & co */
+static int mem_huge = 0;		/* back new heaps with huge pages */
+
+/*
+ * region_map - map maxsize bytes of heap for r, at hint if possible.
+ *		Returns -1 on error.
+ */
+static int region_map(mem_region_t *r, void *hint, size_t maxsize){
+	r->huge = mem_huge;
+	r->fd = -1;
+	r->lock_fd = -1;
+	r->shared = NULL;
+	/* leave room to align the heap to a huge page boundary */
+	r->map_len = r->huge ? maxsize + HUGEPAGE_SIZE : maxsize;
+	/* anonymous rather than /dev/zero, so that pages put back by
+	 * mem_remap merge with the rest of the heap mapping */
+	r->map = mmap(hint,						/* suggested start*/
+			r->map_len,						/* length */
+			PROT_WRITE,						/* permissions */
+			MAP_PRIVATE | MAP_ANONYMOUS,	/* private or shared? */
+			-1,								/* fd */
+			0);								/* offset (dunno) */
+	if (r->map == MAP_FAILED)
+		return -1;
+	r->heap = r->map;
+	if (r->huge) {
+		r->heap = (char *)(((size_t)r->map + HUGEPAGE_SIZE - 1) &
+				~(size_t)(HUGEPAGE_SIZE - 1));
+		madvise(r->heap, maxsize, MADV_HUGEPAGE);
+	}
+	r->max_addr = r->heap + maxsize;
+	r->brk = r->heap;				/* heap is empty initially */
+	r->peak_brk = r->heap;
+	return 0;
+}
 
 /* 
  * mem_init - initialize the memory system model
  */
 void mem_init(void){
-	int dev_zero = open("/dev/zero", O_RDWR);
-	heap = mmap((void *)0x800000000, /* suggested start*/
-			MAX_HEAP,				/* length */
-			PROT_WRITE,				/* permissions */
-			MAP_PRIVATE,			/* private or shared? */
-			dev_zero,				/* fd */
-			0);						/* offset (dunno) */
-	mem_max_addr = heap + MAX_HEAP;
-	mem_brk = heap;					/* heap is empty initially */
+	if (region_map(&mem_default, (void *)0x800000000, MAX_HEAP) < 0) {
+		fprintf(stderr, "ERROR: mem_init could not map the heap\n");
+		exit(1);
+	}
 }
 
 /* 
  * mem_deinit - free the storage used by the memory system model
  */
 void mem_deinit(void){
-	munmap(heap, MAX_HEAP);
+	munmap(mem_default.map, mem_default.map_len);
 }
 
 /*
- * mem_reset_brk - reset the simulated brk pointer to make an empty heap
+ * mem_region_create - create a heap of at most maxsize bytes that is
+ *		independent of the one behind mem_sbrk. Returns NULL on error.
  */
-void mem_reset_brk(){
-	mem_brk = heap;
+mem_region_t *mem_region_create(size_t maxsize){
+	mem_region_t *r = malloc(sizeof(mem_region_t));
+
+	if (r == NULL)
+		return NULL;
+	maxsize = (maxsize + mem_pagesize() - 1) & ~(mem_pagesize() - 1);
+	if (region_map(r, NULL, maxsize) < 0) {
+		free(r);
+		return NULL;
+	}
+	return r;
+}
+
+/*
+ * mem_region_open - create a heap of at most maxsize bytes that lives in
+ *		the file at path, which is made if it does not exist. The file
+ *		is mapped shared, at hint if that range is free, and the heap
+ *		starts out as large as the file is and keeps the file as large
+ *		as itself, so what the heap holds is in the file again the next
+ *		time it is opened. Returns NULL on error.
+ */
+mem_region_t *mem_region_open(const char *path, size_t maxsize, void *hint){
+	mem_region_t *r;
+	struct stat st;
+	int fd;
+
+	maxsize = (maxsize + mem_pagesize() - 1) & ~(mem_pagesize() - 1);
+	if ((fd = open(path, O_RDWR | O_CREAT, 0600)) < 0)
+		return NULL;
+	if (fstat(fd, &st) < 0 || (size_t)st.st_size > maxsize ||
+			(r = malloc(sizeof(mem_region_t))) == NULL) {
+		close(fd);
+		return NULL;
+	}
+	r->map = mmap(hint, maxsize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (r->map == MAP_FAILED) {
+		free(r);
+		close(fd);
+		return NULL;
+	}
+	r->map_len = maxsize;
+	r->huge = 0;
+	r->fd = fd;
+	r->lock_fd = fd;
+	r->shared = NULL;
+	r->heap = r->map;
+	r->max_addr = r->heap + maxsize;
+	r->brk = r->heap + st.st_size;
+	r->peak_brk = r->brk;
+	return r;
+}
+
+/*
+ * shm_lock_made - lock the shared memory object fd for its set up. The
+ *		maker takes the lock at once; an attaching process takes it
+ *		once the maker has sized the object, waiting MEM_SHM_WAIT ms at
+ *		most. Returns -1 on error, with the lock not held.
+ */
+static int shm_lock_made(int fd, int made){
+	struct stat st;
+	int i;
+
+	for (i = 0; ; i++) {
+		if (flock(fd, LOCK_EX) < 0)
+			return -1;
+		if (made || (fstat(fd, &st) == 0 &&
+				(size_t)st.st_size > mem_pagesize()))
+			return 0;
+		flock(fd, LOCK_UN);
+		if (i == MEM_SHM_WAIT) {
+			errno = EAGAIN;
+			return -1;
+		}
+		usleep(1000);
+	}
+}
+
+/*
+ * mem_region_shm - create, or attach to, a heap of at most maxsize bytes
+ *		in the POSIX shared memory object name. Each process that opens
+ *		the object maps it at an address of its own, and sees the heap
+ *		grow through a brk kept in the object; the processes must not
+ *		call mem_region_sbrk at the same time. The creator sets the
+ *		object up under mem_region_lock; an attaching process ignores
+ *		maxsize and waits for that. The object stays until
+ *		shm_unlink(name). Returns NULL on error.
+ */
+mem_region_t *mem_region_shm(const char *name, size_t maxsize){
+	size_t pagesize = mem_pagesize();
+	mem_region_t *r;
+	struct stat st;
+	int fd, made = 1;
+
+	maxsize = (maxsize + pagesize - 1) & ~(pagesize - 1);
+	if ((fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600)) < 0) {
+		made = 0;
+		if (errno != EEXIST || (fd = shm_open(name, O_RDWR, 0)) < 0)
+			return NULL;
+	}
+	if (shm_lock_made(fd, made) < 0) {
+		close(fd);
+		if (made)
+			shm_unlink(name);
+		return NULL;
+	}
+	if ((made && ftruncate(fd, pagesize + maxsize) < 0) ||
+			fstat(fd, &st) < 0 || (size_t)st.st_size <= pagesize ||
+			(r = malloc(sizeof(mem_region_t))) == NULL) {
+		close(fd);
+		if (made)
+			shm_unlink(name);
+		return NULL;
+	}
+	r->map_len = st.st_size;
+	r->map = mmap(NULL, r->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (r->map == MAP_FAILED) {
+		free(r);
+		close(fd);
+		if (made)
+			shm_unlink(name);
+		return NULL;
+	}
+	r->shared = (struct mem_shared *)r->map;
+	if (made) {
+		r->shared->brk = r->shared->peak = 0;
+		r->shared->magic = MEM_SHARED_MAGIC;
+	} else if (r->shared->magic != MEM_SHARED_MAGIC) {
+		/* the maker died setting it up */
+		munmap(r->map, r->map_len);
+		free(r);
+		close(fd);
+		errno = EAGAIN;
+		return NULL;
+	}
+	flock(fd, LOCK_UN);
+	r->huge = 0;
+	r->fd = -1;
+	r->lock_fd = fd;
+	r->heap = r->map + pagesize;
+	r->max_addr = r->map + r->map_len;
+	r->brk = r->heap + r->shared->brk;
+	r->peak_brk = r->heap + r->shared->peak;
+	return r;
+}
+
+/*
+ * region_load - take the brk of a heap in shared memory from its head,
+ *		where another process may have moved it
+ */
+static inline void region_load(mem_region_t *r){
+	if (r->shared) {
+		r->brk = r->heap + r->shared->brk;
+		r->peak_brk = r->heap + r->shared->peak;
+	}
+}
+
+/*
+ * region_store - put the brk of a heap in shared memory into its head
+ */
+static inline void region_store(mem_region_t *r){
+	if (r->shared) {
+		r->shared->brk = r->brk - r->heap;
+		r->shared->peak = r->peak_brk - r->heap;
+	}
+}
+
+/*
+ * mem_region_sync - write the heap of a file backed region to its file
+ *		and wait for it. Returns 0 on success, -1 on error or if the
+ *		region has no file.
+ */
+int mem_region_sync(mem_region_t *r){
+	size_t len = (r->brk - r->heap + mem_pagesize() - 1) &
+			~(mem_pagesize() - 1);
+
+	if (r->fd < 0)
+		return -1;
+	return len ? msync(r->heap, len, MS_SYNC) : 0;
+}
+
+/*
+ * mem_region_destroy - unmap a region made by mem_region_create,
+ *		mem_region_open or mem_region_shm. The file or shared memory
+ *		object of the latter two keeps the heap.
+ */
+void mem_region_destroy(mem_region_t *r){
+	munmap(r->map, r->map_len);
+	if (r->lock_fd >= 0)
+		close(r->lock_fd);
+	free(r);
+}
+
+/*
+ * mem_region_lock - lock the file or shared memory object of r against
+ *		other processes (flock), so one of them at a time can set up
+ *		what the region holds. Nothing for other regions. Returns -1 on
+ *		error.
+ */
+int mem_region_lock(mem_region_t *r){
+	return r->lock_fd < 0 ? 0 : flock(r->lock_fd, LOCK_EX);
+}
+
+/*
+ * mem_region_unlock - undo mem_region_lock
+ */
+void mem_region_unlock(mem_region_t *r){
+	if (r->lock_fd >= 0)
+		flock(r->lock_fd, LOCK_UN);
+}
+
+/*
+ * mem_default_region - returns the region behind mem_sbrk and the other
+ *		mem_* functions without a region argument
+ */
+mem_region_t *mem_default_region(){
+	return &mem_default;
+}
+
+/*
+ * mem_set_hugepages - back the heap with transparent huge pages from
+ *		the next mem_init or mem_region_create on
+ */
+void mem_set_hugepages(int enable){
+	mem_huge = enable;
+}
+
+/*
+ * mem_region_hugepagesize - returns the huge page size backing the heap,
+ *		or 0 if the heap uses normal pages
+ */
+size_t mem_region_hugepagesize(mem_region_t *r){
+	return r->huge ? HUGEPAGE_SIZE : 0;
+}
+
+/*
+ * mem_region_reset_brk - reset the simulated brk pointer to make an
+ *		empty heap
+ */
+void mem_region_reset_brk(mem_region_t *r){
+	r->brk = r->heap;
+	r->peak_brk = r->heap;
+	region_store(r);
+	if (r->fd >= 0 && ftruncate(r->fd, 0) < 0)
+		fprintf(stderr, "ERROR: mem_reset_brk could not truncate the heap file\n");
 }
 
 /* 
- * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *		by incr bytes and returns the start address of the new area. In
- *		this model, the heap cannot be shrunk.
+ * mem_region_sbrk - simple model of the sbrk function. Extends the heap 
+ *		by incr bytes and returns the start address of the new area. A
+ *		negative incr shrinks the heap, but never below its start.
  */
-void *mem_sbrk(int incr) {
-	char *old_brk = mem_brk;
+void *mem_region_sbrk(mem_region_t *r, int incr) {
+	char *old_brk;
 
+	region_load(r);
+	old_brk = r->brk;
+	if (incr < 0 && (r->brk + incr) < r->heap) {
+		errno = EINVAL;
+		return (void *)-1;
+	}
+	if ((r->brk + incr) > r->max_addr) {
+		errno = ENOMEM;
+		fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
+		return (void *)-1;
+	}
+	/* the pages of a file mapping past the end of the file cannot be used */
+	if (r->fd >= 0 && ftruncate(r->fd, r->brk + incr - r->heap) < 0) {
+		errno = ENOMEM;
+		fprintf(stderr, "ERROR: mem_sbrk could not grow the heap file\n");
+		return (void *)-1;
+	}
     // call sbrk() in an attempt to have similar semantics as a real allocator.
-	if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr) ||
-            sbrk(incr) == (void *) -1) {
+	/* only to grow: shrinking the real break would unmap the top of the
+	 * libc heap, which has nothing to do with this one */
+	if (incr > 0 && sbrk(incr) == (void *) -1) {
+		if (r->fd >= 0 && ftruncate(r->fd, r->brk - r->heap) < 0)
+			perror("mem_sbrk");
 		errno = ENOMEM;
 		fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
 		return (void *)-1;
 	}
-
-	mem_brk += incr;
+	r->brk += incr;
+	if (r->brk > r->peak_brk)
+		r->peak_brk = r->brk;
+	region_store(r);
 	return (void *)old_brk;
 }
 
 /*
- * mem_heap_lo - return address of the first heap byte
+ * mem_region_lo - return address of the first heap byte
  */
-void *mem_heap_lo(){
-	return (void *)heap;
+void *mem_region_lo(mem_region_t *r){
+	return (void *)r->heap;
 }
 
 /* 
- * mem_heap_hi - return address of last heap byte
+ * mem_region_hi - return address of last heap byte
  */
-void *mem_heap_hi(){
-	return (void *)(mem_brk - 1);
+void *mem_region_hi(mem_region_t *r){
+	region_load(r);
+	return (void *)(r->brk - 1);
 }
 
 /*
- * mem_heapsize() - returns the heap size in bytes
+ * mem_region_size() - returns the heap size in bytes
  */
+size_t mem_region_size(mem_region_t *r) {
+	region_load(r);
+	return (size_t)((void *)r->brk - (void *)r->heap);
+}
+
+/*
+ * mem_region_peak() - returns the largest size the heap has had since
+ *		it was last reset, in bytes
+ */
+size_t mem_region_peak(mem_region_t *r) {
+	region_load(r);
+	return (size_t)((void *)r->peak_brk - (void *)r->heap);
+}
+
+/*
+ * The functions below without a region argument work on the region
+ * that mem_init maps.
+ */
+size_t mem_hugepagesize(){
+	return mem_region_hugepagesize(&mem_default);
+}
+
+void mem_reset_brk(){
+	mem_region_reset_brk(&mem_default);
+}
+
+void *mem_sbrk(int incr) {
+	return mem_region_sbrk(&mem_default, incr);
+}
+
+void *mem_heap_lo(){
+	return mem_region_lo(&mem_default);
+}
+
+void *mem_heap_hi(){
+	return mem_region_hi(&mem_default);
+}
+
 size_t mem_heapsize() {
-	return (size_t)((void *)mem_brk - (void *)heap);
+	return mem_region_size(&mem_default);
+}
+
+size_t mem_heappeak() {
+	return mem_region_peak(&mem_default);
 }
 
 /*
@@ -97,3 +459,129 @@ size_t mem_heapsize() {
 size_t mem_pagesize(){
 	return (size_t)getpagesize();
 }
+
+/*
+ * mem_region_release - give the physical pages that lie entirely inside
+ *		[lo, lo + len) of r back to the OS. The range stays mapped and
+ *		reads back as zeros the next time it is touched. MADV_DONTNEED
+ *		only drops the mapping of the pages of a file or shared memory
+ *		object, which keeps them, so there the pages are punched out of
+ *		it with MADV_REMOVE. Returns the number of bytes released, 0 if
+ *		the file system cannot do that.
+ */
+size_t mem_region_release(mem_region_t *r, void *lo, size_t len){
+	size_t pagesize = mem_pagesize();
+	size_t start = ((size_t)lo + pagesize - 1) & ~(pagesize - 1);
+	size_t end = ((size_t)lo + len) & ~(pagesize - 1);
+	int advice = r->fd >= 0 || r->shared ? MADV_REMOVE : MADV_DONTNEED;
+
+	if (end <= start)
+		return 0;
+	if (madvise((void *)start, end - start, advice) < 0)
+		return 0;
+	return end - start;
+}
+
+size_t mem_release(void *lo, size_t len){
+	return mem_region_release(&mem_default, lo, len);
+}
+
+/*
+ * mem_prefault - fault in the pages that [lo, lo + len) touches, ready
+ *		for writing, without changing what they hold. Returns the
+ *		number of bytes of those pages.
+ */
+size_t mem_prefault(void *lo, size_t len){
+	size_t pagesize = mem_pagesize();
+	size_t start = (size_t)lo & ~(pagesize - 1);
+	size_t end = ((size_t)lo + len + pagesize - 1) & ~(pagesize - 1);
+	volatile char *p;
+
+	if (len == 0)
+		return 0;
+#ifdef MADV_POPULATE_WRITE
+	if (madvise((void *)start, end - start, MADV_POPULATE_WRITE) == 0)
+		return end - start;
+#endif
+	/* older kernels: write a byte of each page back as it is */
+	*(volatile char *)lo = *(volatile char *)lo;
+	for (p = (char *)start + pagesize; (size_t)p < (size_t)lo + len;
+	     p += pagesize)
+		*p = *p;
+	return end - start;
+}
+
+/*
+ * mem_region_remap - move the pages of [src, src + len) to [dst, dst + len)
+ *		without copying them, and put fresh zero pages back at src. Both
+ *		ranges must be page aligned, lie inside the heap of r and not
+ *		overlap.
+ *		Returns 0 on success. On error returns -1; src is unchanged and
+ *		dst is left holding zero pages, or untouched if the ranges are
+ *		not valid or the heap is in a file or shared memory, whose pages
+ *		stay at their offsets.
+ */
+int mem_region_remap(mem_region_t *r, void *dst, void *src, size_t len){
+	size_t pagesize = mem_pagesize();
+	if (r->fd >= 0 || r->shared ||((size_t)dst | (size_t)src | len) & (pagesize - 1) ||
+			(char *)src < r->heap || (char *)src + len > r->max_addr ||
+			(char *)dst < r->heap || (char *)dst + len > r->max_addr ||
+			((char *)dst < (char *)src + len && (char *)src < (char *)dst + len)) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (len == 0)
+		return 0;
+	/* a failed mremap may already have unmapped dst */
+	if (mremap(src, len, len, MREMAP_MAYMOVE | MREMAP_FIXED, dst) == MAP_FAILED) {
+		if (mmap(dst, len, PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED,
+				-1, 0) == MAP_FAILED) {
+			fprintf(stderr, "ERROR: mem_remap could not refill the heap\n");
+			exit(1);
+		}
+		if (r->huge)
+			madvise(dst, len, MADV_HUGEPAGE);
+		return -1;
+	}
+	/* refill the hole so that the heap stays one contiguous range */
+	if (mmap(src, len, PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED) {
+		fprintf(stderr, "ERROR: mem_remap could not refill the heap\n");
+		exit(1);
+	}
+	if (r->huge)
+		madvise(src, len, MADV_HUGEPAGE);
+	return 0;
+}
+
+int mem_remap(void *dst, void *src, size_t len){
+	return mem_region_remap(&mem_default, dst, src, len);
+}
+
+/*
+ * mem_region_resident - returns the number of heap bytes currently
+ *		backed by physical pages
+ */
+size_t mem_region_resident(mem_region_t *r){
+	size_t pagesize = mem_pagesize();
+	size_t npages = (mem_region_size(r) + pagesize - 1) / pagesize;
+	size_t i, n, resident = 0;
+	unsigned char vec[256];
+	char *p = r->heap;
+
+	while (npages > 0) {
+		n = npages < sizeof(vec) ? npages : sizeof(vec);
+		if (mincore(p, n * pagesize, vec) < 0)
+			break;
+		for (i = 0; i < n; i++)
+			if (vec[i] & 1)
+				resident += pagesize;
+		p += n * pagesize;
+		npages -= n;
+	}
+	return resident;
+}
+
+size_t mem_resident(){
+	return mem_region_resident(&mem_default);
+}
@@ -7,5 +7,33 @@ void mem_reset_brk(void);
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
+size_t mem_heappeak(void);
 size_t mem_pagesize(void);
+void mem_set_hugepages(int enable);
+size_t mem_hugepagesize(void);
+size_t mem_release(void *lo, size_t len);
+size_t mem_prefault(void *lo, size_t len);
+int mem_remap(void *dst, void *src, size_t len);
+size_t mem_resident(void);
+
+/* Independent heaps; the functions above work on mem_default_region() */
+typedef struct mem_region mem_region_t;
+mem_region_t *mem_region_create(size_t maxsize);
+mem_region_t *mem_region_open(const char *path, size_t maxsize, void *hint);
+int mem_region_sync(mem_region_t *r);
+mem_region_t *mem_region_shm(const char *name, size_t maxsize);
+int mem_region_lock(mem_region_t *r);
+void mem_region_unlock(mem_region_t *r);
+void mem_region_destroy(mem_region_t *r);
+mem_region_t *mem_default_region(void);
+void *mem_region_sbrk(mem_region_t *r, int incr);
+void mem_region_reset_brk(mem_region_t *r);
+void *mem_region_lo(mem_region_t *r);
+void *mem_region_hi(mem_region_t *r);
+size_t mem_region_size(mem_region_t *r);
+size_t mem_region_peak(mem_region_t *r);
+size_t mem_region_hugepagesize(mem_region_t *r);
+int mem_region_remap(mem_region_t *r, void *dst, void *src, size_t len);
+size_t mem_region_resident(mem_region_t *r);
+size_t mem_region_release(mem_region_t *r, void *lo, size_t len);
 
@@ -0,0 +1,481 @@
+/*
+ * mm-bitmap.c
+ * allocator with its block boundaries out of band, over memlib:
+ * 1) the heap is cut into 8-byte granules. Two bitmaps in a memlib region
+ *    of their own, apart from the heap, hold one bit per granule: one
+ *    marks the first granule of every block, the other whether that block
+ *    is allocated. An allocated block is all payload, with no header or
+ *    footer, so freeing it and merging it with its neighbours never
+ *    touches the lines around the payload, and a payload overrun cannot
+ *    change the size or state of any block;
+ * 2) the size of a block is the distance to the next start bit, and the
+ *    block before it starts at the previous start bit. Both are found a
+ *    64-bit word at a time with a bit scan, and the start and allocated
+ *    bits of 64 granules share one 16-byte pair of words, so a block's
+ *    metadata is a single cache line;
+ * 3) granule 0 is an allocated one-granule prologue and the granule at
+ *    the end of the heap carries an allocated start bit but no memory, so
+ *    the scans always stop;
+ * 4) free blocks, at least one granule, hold the next/prev granule
+ *    numbers of their free list in their own first 8 bytes. The lists are
+ *    two-level segregated as in mm-tlsf.c, so a fit takes two bit scans;
+ * 5) the metadata costs 2 bits per 8 bytes of heap, 1/32 of its size,
+ *    and lives outside the memlib heap; mm_meta_peak reports it, so that
+ *    mdriver counts it in the heap size it measures utilization against.
+ */
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "memlib.h"
+#include "mm.h"
+
+/* do not change the following! */
+#ifdef DRIVER
+/* create aliases for driver tests */
+#define malloc mm_malloc
+#define free mm_free
+#define realloc mm_realloc
+#define calloc mm_calloc
+#endif /* def DRIVER */
+
+/* Basic constants and macros */
+#define GRAN 8              /* Granule size (bytes) */
+#define CHUNKSIZE (1 << 12) /* Extend heap by this amount (bytes) */
+#define HEAP_MAX ((size_t)1 << 32) /* Largest heap the bitmaps can cover */
+
+#define MAX(x, y) ((x) > (y) ? (x) : (y))
+
+/* Segregated list geometry, as in mm-tlsf.c */
+#define SL_SHIFT 4                   /* log2 of lists per first level */
+#define SL_COUNT (1 << SL_SHIFT)     /* Lists per first level */
+#define FL_SHIFT (SL_SHIFT + 3)      /* Sizes are multiples of 8 */
+#define SMALL_SIZE (1 << FL_SHIFT)   /* Below this, lists are linear */
+#define FL_COUNT (32 - FL_SHIFT + 1) /* Up to HEAP_MAX */
+
+/* Granule number of a block pointer and back */
+#define GNUM(bp) ((size_t)((char *)(bp)-heap_base) / GRAN)
+#define BLKP(g) (heap_base + (size_t)(g)*GRAN)
+
+/* Free list links in the first granule of a free block, 0 ends a list */
+#define NEXT_FR(g) (((uint32_t *)BLKP(g))[0])
+#define PREV_FR(g) (((uint32_t *)BLKP(g))[1])
+
+/* The bits of 64 granules */
+typedef struct bm_word {
+  uint64_t start; /* First granule of a block */
+  uint64_t alloc; /* Block starting here is allocated */
+} bm_word_t;
+
+#define BIT(g) ((uint64_t)1 << ((g) % 64))
+#define WORD(g) (bitmap[(g) / 64])
+#define IS_START(g) ((WORD(g).start & BIT(g)) != 0)
+#define IS_ALLOC(g) ((WORD(g).alloc & BIT(g)) != 0)
+#define SET_START(g) (WORD(g).start |= BIT(g))
+#define CLEAR_START(g) (WORD(g).start &= ~BIT(g))
+#define SET_ALLOC(g) (WORD(g).alloc |= BIT(g))
+#define CLEAR_ALLOC(g) (WORD(g).alloc &= ~BIT(g))
+
+/* Global variables */
+static char *heap_base = 0;                     /* Granule 0 */
+static size_t heap_end;                         /* Granule past the heap */
+static mem_region_t *meta;                      /* Region of the bitmaps */
+static bm_word_t *bitmap;                       /* The bitmaps */
+static size_t bitmap_words;                     /* Words in the region */
+static unsigned int fl_bitmap = 0;              /* Non-empty first levels */
+static unsigned int sl_bitmap[FL_COUNT];        /* Non-empty lists */
+static uint32_t blocks[FL_COUNT][SL_COUNT];     /* Heads of the lists */
+
+/* Function prototypes for internal helper routines */
+static size_t next_start(size_t g);
+static size_t prev_start(size_t g);
+static int grow_bitmap(void);
+static size_t extend_heap(size_t size);
+static void place(size_t g, size_t n);
+static size_t coalesce(size_t g, size_t *n);
+static size_t find_fit(size_t asize);
+static void mapping(size_t size, int *fl, int *sl);
+static void add_free_block(size_t g, size_t n);
+static void delete_free_block(size_t g, size_t n);
+
+/*
+ * Initialize: return -1 on error, 0 on success.
+ */
+int mm_init(void) {
+  if (meta == NULL &&
+      (meta = mem_region_create(HEAP_MAX / GRAN / 64 * sizeof(bm_word_t))) ==
+          NULL)
+    return -1;
+  mem_region_reset_brk(meta);
+  bitmap = mem_region_lo(meta);
+  bitmap_words = 0;
+
+  /* Create the prologue granule and the end mark after it */
+  if ((heap_base = mem_sbrk(GRAN)) == (void *)-1)
+    return -1;
+  heap_end = 1;
+  if (grow_bitmap() < 0)
+    return -1;
+  SET_START(0);
+  SET_ALLOC(0);
+  fl_bitmap = 0;
+  memset(sl_bitmap, 0, sizeof(sl_bitmap));
+  memset(blocks, 0, sizeof(blocks));
+  /* Extend the empty heap with a free block of CHUNKSIZE bytes */
+  if (extend_heap(CHUNKSIZE) == 0)
+    return -1;
+  return 0;
+}
+
+/*
+ * malloc - Allocate a block with at least size bytes of payload
+ */
+void *mm_malloc(size_t size) {
+  size_t asize; /* Adjusted block size */
+  size_t g;
+  if (heap_base == 0) {
+    mm_init();
+  }
+  /* Ignore spurious requests */
+  if (size == 0)
+    return NULL;
+
+  /* Whole granules, no overhead */
+  asize = (size + GRAN - 1) & ~(size_t)(GRAN - 1);
+
+  /* Search the free lists for a fit, else get more memory */
+  if ((g = find_fit(asize)) == 0 &&
+      (g = extend_heap(MAX(asize, CHUNKSIZE))) == 0)
+    return NULL;
+  place(g, asize / GRAN);
+  return BLKP(g);
+}
+
+/*
+ * free - Free a block
+ */
+void mm_free(void *bp) {
+  size_t g, n;
+  if (bp == 0)
+    return;
+  if (heap_base == 0) {
+    mm_init();
+  }
+
+  g = GNUM(bp);
+  n = next_start(g) - g;
+  CLEAR_ALLOC(g);
+  g = coalesce(g, &n);
+  add_free_block(g, n);
+}
+
+/*
+ * mm_meta_peak - Peak bytes of the bitmaps since mm_init
+ */
+size_t mm_meta_peak(void) { return meta ? mem_region_peak(meta) : 0; }
+
+/*
+ * realloc - Shrink or grow the block in place when the blocks after it
+ *           are free or it ends the heap, otherwise fall back to malloc,
+ *           copy and free
+ */
+void *mm_realloc(void *ptr, size_t size) {
+  size_t g, n, cur, nx, nn;
+  void *newptr;
+
+  /* If size == 0 then this is just free, and we return NULL. */
+  if (size == 0) {
+    mm_free(ptr);
+    return 0;
+  }
+
+  /* If oldptr is NULL, then this is just malloc. */
+  if (ptr == NULL) {
+    return mm_malloc(size);
+  }
+
+  g = GNUM(ptr);
+  n = (size + GRAN - 1) / GRAN;
+  cur = next_start(g) - g;
+  nx = g + cur;
+  nn = IS_ALLOC(nx) ? 0 : next_start(nx) - nx;
+  /* a block that ends the heap grows with it */
+  if (cur + nn < n && nx + nn == heap_end) {
+    if (extend_heap((n - cur - nn) * GRAN) == 0)
+      return 0;
+    nn = n - cur;
+  }
+  if (cur + nn >= n) {
+    if (nn) {
+      delete_free_block(nx, nn);
+      CLEAR_START(nx);
+    }
+    /* the remainder has an allocated block after it */
+    if (cur + nn > n) {
+      SET_START(g + n);
+      add_free_block(g + n, cur + nn - n);
+    }
+    return ptr;
+  }
+
+  newptr = mm_malloc(size);
+
+  /* If realloc() fails the original block is left untouched  */
+  if (!newptr) {
+    return 0;
+  }
+
+  /* Copy the old data. */
+  memcpy(newptr, ptr, cur * GRAN < size ? cur * GRAN : size);
+
+  /* Free the old block. */
+  mm_free(ptr);
+
+  return newptr;
+}
+
+/*
+ * The remaining routines are internal helper routines
+ */
+
+/*
+ * next_start - The first granule after g that starts a block
+ */
+static size_t next_start(size_t g) {
+  size_t i = g / 64;
+  uint64_t w = bitmap[i].start & (~(uint64_t)1 << (g % 64));
+  while (w == 0)
+    w = bitmap[++i].start;
+  return i * 64 + __builtin_ctzl(w);
+}
+
+/*
+ * prev_start - The last granule before g, which is not 0, that starts a
+ *              block
+ */
+static size_t prev_start(size_t g) {
+  size_t i = g / 64;
+  uint64_t w = bitmap[i].start & (BIT(g) - 1);
+  while (w == 0)
+    w = bitmap[--i].start;
+  return i * 64 + 63 - __builtin_clzl(w);
+}
+
+/*
+ * grow_bitmap - Make the bitmaps cover the heap and the end mark, and
+ *               put the end mark at the end of the heap. Return -1 on
+ *               error.
+ */
+static int grow_bitmap(void) {
+  size_t words = heap_end / 64 + 1;
+  bm_word_t *w;
+
+  if (words > bitmap_words) {
+    if ((w = mem_region_sbrk(meta, (words - bitmap_words) *
+                                       sizeof(bm_word_t))) == (void *)-1)
+      return -1;
+    memset(w, 0, (words - bitmap_words) * sizeof(bm_word_t));
+    bitmap_words = words;
+  }
+  SET_START(heap_end);
+  SET_ALLOC(heap_end);
+  return 0;
+}
+
+/*
+ * extend_heap - Extend the heap by size bytes, a multiple of GRAN, as a
+ *               free block merged with a free block before it. Return
+ *               the merged block, on a list, or 0 on error.
+ */
+static size_t extend_heap(size_t size) {
+  size_t g = heap_end, n = size / GRAN;
+
+  if (mem_sbrk(size) == (void *)-1)
+    return 0;
+  heap_end += n;
+  if (grow_bitmap() < 0)
+    return 0;
+  /* the old end mark starts the new free block */
+  CLEAR_ALLOC(g);
+  g = coalesce(g, &n);
+  add_free_block(g, n);
+  return g;
+}
+
+/*
+ * coalesce - Merge the free block of n granules at g, which is on no
+ *            list, with its free neighbours, taking them off their lists.
+ *            Return the merged block, which is on no list, and its size
+ *            in n.
+ */
+static size_t coalesce(size_t g, size_t *n) {
+  size_t nx = g + *n, p, m;
+
+  if (!IS_ALLOC(nx)) {
+    m = next_start(nx) - nx;
+    delete_free_block(nx, m);
+    CLEAR_START(nx);
+    *n += m;
+  }
+  p = prev_start(g);
+  if (!IS_ALLOC(p)) {
+    m = g - p;
+    delete_free_block(p, m);
+    CLEAR_START(g);
+    *n += m;
+    g = p;
+  }
+  return g;
+}
+
+/*
+ * place - Allocate the first n granules of the free block at g and put
+ *         the rest, if any, back on a list
+ */
+static void place(size_t g, size_t n) {
+  size_t csize = next_start(g) - g;
+  delete_free_block(g, csize);
+  if (csize > n) {
+    SET_START(g + n);
+    add_free_block(g + n, csize - n);
+  }
+  SET_ALLOC(g);
+}
+
+/*
+ * mapping - Compute the first and second level list of a block size
+ */
+static void mapping(size_t size, int *fl, int *sl) {
+  int msb;
+  if (size < SMALL_SIZE) {
+    *fl = 0;
+    *sl = size / (SMALL_SIZE / SL_COUNT);
+  } else {
+    msb = 63 - __builtin_clzl(size);
+    *fl = msb - FL_SHIFT + 1;
+    *sl = (size >> (msb - SL_SHIFT)) ^ SL_COUNT;
+  }
+}
+
+/*
+ * find_fit - Find a free block of at least asize bytes, return its
+ *            granule or 0. The size is rounded up to the next list first
+ *            so that the head of any non-empty list at or above it fits.
+ */
+static size_t find_fit(size_t asize) {
+  int fl, sl;
+  unsigned int map;
+  if (asize >= SMALL_SIZE)
+    asize += (1UL << (63 - __builtin_clzl(asize) - SL_SHIFT)) - 1;
+  mapping(asize, &fl, &sl);
+  if (fl >= FL_COUNT)
+    return 0;
+  map = sl_bitmap[fl] & (~0u << sl);
+  if (map == 0) {
+    if (fl + 1 >= FL_COUNT || (map = fl_bitmap & (~0u << (fl + 1))) == 0)
+      return 0;
+    fl = __builtin_ctz(map);
+    map = sl_bitmap[fl];
+  }
+  sl = __builtin_ctz(map);
+  return blocks[fl][sl];
+}
+
+/* put the free block of n granules at g at the head of the list of its
+ * size
+ */
+static void add_free_block(size_t g, size_t n) {
+  int fl, sl;
+  uint32_t head;
+  mapping(n * GRAN, &fl, &sl);
+  head = blocks[fl][sl];
+  NEXT_FR(g) = head;
+  PREV_FR(g) = 0;
+  if (head)
+    PREV_FR(head) = g;
+  blocks[fl][sl] = g;
+  fl_bitmap |= 1u << fl;
+  sl_bitmap[fl] |= 1u << sl;
+}
+
+/* take the free block of n granules at g off the list of its size
+ */
+static void delete_free_block(size_t g, size_t n) {
+  int fl, sl;
+  uint32_t next = NEXT_FR(g);
+  uint32_t prev = PREV_FR(g);
+  mapping(n * GRAN, &fl, &sl);
+  if (next)
+    PREV_FR(next) = prev;
+  if (prev) {
+    NEXT_FR(prev) = next;
+  } else if ((blocks[fl][sl] = next) == 0) {
+    sl_bitmap[fl] &= ~(1u << sl);
+    if (sl_bitmap[fl] == 0)
+      fl_bitmap &= ~(1u << fl);
+  }
+}
+
+/**************************************
+ * CHECK heap functions
+ *
+ *************************************/
+
+void mm_checkheap(int lineno) {
+  size_t g, n, i;
+  unsigned int nfree = 0, nlisted = 0;
+  uint32_t off;
+  int fl, sl, f, s, prev_free = 0;
+
+  if (!IS_START(0) || !IS_ALLOC(0) || next_start(0) != 1)
+    printf("line %d: prologue granule is wrong\n", lineno);
+  if (BLKP(heap_end) != (char *)mem_heap_hi() + 1)
+    printf("line %d: end mark is not at the end of the heap\n", lineno);
+  if (!IS_START(heap_end) || !IS_ALLOC(heap_end))
+    printf("line %d: end mark is missing\n", lineno);
+  for (i = 0; i < bitmap_words; i++)
+    if (bitmap[i].alloc & ~bitmap[i].start)
+      printf("line %d: allocated bits off block starts in word %zu\n",
+             lineno, i);
+  if (bitmap[heap_end / 64].start & ~(BIT(heap_end) | (BIT(heap_end) - 1)))
+    printf("line %d: start bits past the end mark\n", lineno);
+
+  /* walk the blocks */
+  for (g = 1; g < heap_end; g += n) {
+    n = next_start(g) - g;
+    if (!IS_ALLOC(g)) {
+      nfree++;
+      if (prev_free)
+        printf("line %d: free block at granule %zu and the one before it"
+               " not merged\n", lineno, g);
+    }
+    prev_free = !IS_ALLOC(g);
+  }
+  if (g != heap_end)
+    printf("line %d: blocks run past the end mark\n", lineno);
+
+  /* walk the lists */
+  for (f = 0; f < FL_COUNT; f++) {
+    if (!(fl_bitmap & (1u << f)) != (sl_bitmap[f] == 0))
+      printf("line %d: first level bit %d is wrong\n", lineno, f);
+    for (s = 0; s < SL_COUNT; s++) {
+      if (!(sl_bitmap[f] & (1u << s)) != (blocks[f][s] == 0))
+        printf("line %d: second level bit %d/%d is wrong\n", lineno, f, s);
+      for (off = blocks[f][s]; off; off = NEXT_FR(off)) {
+        nlisted++;
+        if (!IS_START(off) || IS_ALLOC(off))
+          printf("line %d: granule %u on list %d/%d is no free block\n",
+                 lineno, off, f, s);
+        mapping((next_start(off) - off) * GRAN, &fl, &sl);
+        if (fl != f || sl != s)
+          printf("line %d: block on list %d/%d belongs on %d/%d\n", lineno, f,
+                 s, fl, sl);
+      }
+    }
+  }
+  if (nfree != nlisted)
+    printf("line %d: %u free blocks, %u on lists\n", lineno, nfree, nlisted);
+}
@@ -0,0 +1,360 @@
+/*
+ * mm-buddy.c
+ * binary buddy allocator over memlib:
+ * 1) every block is 2^k bytes (MIN_ORDER <= k <= MAX_ORDER) and starts at
+ *    an offset from the heap base that is a multiple of its size, so the
+ *    buddy of the block at off is the block at off ^ 2^k;
+ * 2) a block starts with an 8 byte header holding its order and allocated
+ *    bit; a free block also holds next/prev offsets of its free list;
+ * 3) one bit per 16-byte granule in a side bitmap marks where free blocks
+ *    start, so checking whether a buddy is free never walks a list;
+ * 4) the heap only grows as far as the highest block handed out (the
+ *    frontier); space above it is carved lazily, and a block freed at the
+ *    frontier gives the space back to it. The memlib heap only has to
+ *    cover the payload of the block at the frontier, not all of it;
+ * 5) offsets start at START_OFF, just below a 64 MB boundary, not at 0.
+ *    The first block of 64 KB or more then starts near the bottom of the
+ *    memlib heap instead of a whole block size above it, so a request of
+ *    more than half of MAX_HEAP still fits after small blocks are out.
+ *    No block lies below START_OFF, so no buddy there is ever free.
+ */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "memlib.h"
+#include "mm.h"
+
+/* do not change the following! */
+#ifdef DRIVER
+/* create aliases for driver tests */
+#define malloc mm_malloc
+#define free mm_free
+#define realloc mm_realloc
+#define calloc mm_calloc
+#endif /* def DRIVER */
+
+/* Basic constants and macros */
+#define HSIZE 8          /* Header size (bytes) */
+#define GRAIN 16         /* Smallest block and bitmap granule (bytes) */
+#define MIN_ORDER 4      /* log2(GRAIN) */
+#define MAX_ORDER 27     /* Largest block is 128 MB, above MAX_HEAP */
+#define START_OFF ((1UL << 26) - (1UL << 16)) /* Offset of the first block */
+#define NIL 0xffffffffu  /* End of a free list */
+#define ALLOC_BIT 0x80
+
+/* Read and write a word at address p */
+#define GET(p) (*(unsigned int *)(p))
+#define PUT(p, val) (*(unsigned int *)(p) = (val))
+
+/* Block at offset off, its header fields and free list links */
+#define BLK(off) (base + (off))
+#define ORDER(off) (GET(BLK(off)) & 0x1f)
+#define IS_ALLOC(off) (GET(BLK(off)) & ALLOC_BIT)
+#define NEXT(off) (BLK(off) + 2 * sizeof(unsigned int))
+#define PREV(off) (BLK(off) + 3 * sizeof(unsigned int))
+
+/* Free block bitmap, one bit per granule, for offsets up to twice the
+ * largest block, past START_OFF plus MAX_HEAP */
+#define MAP_WORDS ((1UL << (MAX_ORDER + 1)) / GRAIN / 64)
+#define MAP_IDX(off) ((off) / GRAIN / 64)
+#define MAP_BIT(off) (1UL << ((off) / GRAIN % 64))
+
+/* Global variables */
+static char *base = 0;                        /* Offset 0 of the heap */
+static size_t frontier = 0;                   /* End of carved space */
+static size_t brk_off = 0;                    /* End of the memlib heap */
+static size_t map_used = 0;                   /* Highest frontier so far */
+static unsigned int free_head[MAX_ORDER + 1]; /* Free list of each order */
+static unsigned int avail = 0;                /* Orders with free blocks */
+static unsigned long freemap[MAP_WORDS];      /* Starts of free blocks */
+
+/* Function prototypes for internal helper routines */
+static int order_for(size_t size);
+static int ensure(size_t end);
+static void push(size_t off, int k);
+static void unlink_block(size_t off, int k);
+static void free_block(size_t off, int k);
+static int is_free_order(size_t off, int k);
+
+/*
+ * Initialize: return -1 on error, 0 on success.
+ */
+int mm_init(void) {
+  char *brk = (char *)mem_heap_hi() + 1;
+  size_t pad = (GRAIN - (size_t)brk % GRAIN) % GRAIN;
+  if (pad && mem_sbrk(pad) == (void *)-1)
+    return -1;
+  base = brk + pad - START_OFF;
+  frontier = brk_off = START_OFF;
+  /* only the part of the bitmap used by earlier heaps can be dirty */
+  memset(freemap, 0, (MAP_IDX(map_used) + 1) * sizeof(unsigned long));
+  map_used = START_OFF;
+  memset(free_head, 0xff, sizeof(free_head));
+  avail = 0;
+  return 0;
+}
+
+/*
+ * malloc - Allocate a block of the smallest order that holds size bytes
+ *          of payload. Split a larger free block if there is one,
+ *          otherwise carve the block from the frontier.
+ */
+void *mm_malloc(size_t size) {
+  size_t off, start;
+  int j, k;
+  if (base == 0) {
+    mm_init();
+  }
+  /* Ignore spurious requests */
+  if (size == 0)
+    return NULL;
+  if ((k = order_for(size)) < 0)
+    return NULL;
+
+  if (avail >> k) {
+    j = k + __builtin_ctz(avail >> k);
+    off = free_head[j];
+    unlink_block(off, j);
+    /* keep the lower half, give back the upper halves */
+    while (j > k) {
+      j--;
+      push(off + (1UL << j), j);
+    }
+  } else {
+    start = (frontier + (1UL << k) - 1) & ~((1UL << k) - 1);
+    if (ensure(start + HSIZE + size) < 0)
+      return NULL;
+    /* hand the alignment gap out as the largest aligned free blocks */
+    off = frontier;
+    frontier = start + (1UL << k);
+    while (off < start) {
+      j = __builtin_ctzl(off | (1UL << MAX_ORDER));
+      while (off + (1UL << j) > start)
+        j--;
+      free_block(off, j);
+      off += 1UL << j;
+    }
+    off = start;
+    if (frontier > map_used)
+      map_used = frontier;
+  }
+  PUT(BLK(off), k | ALLOC_BIT);
+  return BLK(off) + HSIZE;
+}
+
+/*
+ * free - Free a block and coalesce it with its buddies
+ */
+void mm_free(void *bp) {
+  size_t off;
+  if (bp == 0)
+    return;
+  off = (char *)bp - HSIZE - base;
+  free_block(off, ORDER(off));
+}
+
+/*
+ * realloc - Keep the block if it is big enough. Otherwise try to grow it
+ *           in place by absorbing free upper buddies (or the space past
+ *           the frontier), and fall back to malloc, copy and free.
+ */
+void *mm_realloc(void *ptr, size_t size) {
+  size_t off, end, oldsize;
+  int j, k, nk;
+  void *newptr;
+
+  /* If size == 0 then this is just free, and we return NULL. */
+  if (size == 0) {
+    mm_free(ptr);
+    return 0;
+  }
+
+  /* If oldptr is NULL, then this is just malloc. */
+  if (ptr == NULL) {
+    return mm_malloc(size);
+  }
+
+  off = (char *)ptr - HSIZE - base;
+  k = ORDER(off);
+  if ((nk = order_for(size)) < 0)
+    return NULL;
+  if (nk <= k)
+    return ensure(off + HSIZE + size) == 0 ? ptr : NULL;
+
+  /* the block must be the lower half at every level it grows through */
+  end = off + (1UL << nk);
+  for (j = k; j < nk; j++) {
+    size_t buddy = off + (1UL << j);
+    if ((off & (1UL << j)) || (buddy < frontier && !is_free_order(buddy, j)))
+      break;
+  }
+  if (j == nk && ensure(off + HSIZE + size) == 0) {
+    for (j = k; j < nk; j++) {
+      size_t buddy = off + (1UL << j);
+      if (buddy < frontier)
+        unlink_block(buddy, j);
+    }
+    if (end > frontier)
+      frontier = end;
+    if (frontier > map_used)
+      map_used = frontier;
+    PUT(BLK(off), nk | ALLOC_BIT);
+    return ptr;
+  }
+
+  newptr = mm_malloc(size);
+
+  /* If realloc() fails the original block is left untouched  */
+  if (!newptr) {
+    return 0;
+  }
+
+  /* Copy the old data. */
+  oldsize = (1UL << k) - HSIZE;
+  if (size < oldsize)
+    oldsize = size;
+  memcpy(newptr, ptr, oldsize);
+
+  /* Free the old block. */
+  mm_free(ptr);
+
+  return newptr;
+}
+
+/*
+ * The remaining routines are internal helper routines
+ */
+
+/*
+ * order_for - Return the order of the smallest block that holds size
+ *             bytes of payload, or -1 if no block is that large
+ */
+static int order_for(size_t size) {
+  size_t need = size + HSIZE;
+  int k;
+  if (need > (1UL << MAX_ORDER))
+    return -1;
+  k = need <= GRAIN ? MIN_ORDER : 64 - __builtin_clzl(need - 1);
+  return k;
+}
+
+/*
+ * ensure - Grow the memlib heap so that it covers offsets below end.
+ *          Only the block at the frontier can reach past the heap, so
+ *          every other block and header is always covered.
+ */
+static int ensure(size_t end) {
+  if (end <= brk_off)
+    return 0;
+  if (mem_sbrk(end - brk_off) == (void *)-1)
+    return -1;
+  brk_off = end;
+  return 0;
+}
+
+/*
+ * is_free_order - Whether a free block of order k starts at off
+ */
+static int is_free_order(size_t off, int k) {
+  return (freemap[MAP_IDX(off)] & MAP_BIT(off)) && ORDER(off) == (unsigned)k;
+}
+
+/*
+ * push - Put the block at off on the free list of order k
+ */
+static void push(size_t off, int k) {
+  unsigned int head = free_head[k];
+  PUT(BLK(off), k);
+  PUT(NEXT(off), head);
+  PUT(PREV(off), NIL);
+  if (head != NIL)
+    PUT(PREV(head), off);
+  free_head[k] = off;
+  avail |= 1u << k;
+  freemap[MAP_IDX(off)] |= MAP_BIT(off);
+}
+
+/*
+ * unlink_block - Take the free block at off off the list of order k
+ */
+static void unlink_block(size_t off, int k) {
+  unsigned int next = GET(NEXT(off));
+  unsigned int prev = GET(PREV(off));
+  if (prev != NIL)
+    PUT(NEXT(prev), next);
+  else
+    free_head[k] = next;
+  if (next != NIL)
+    PUT(PREV(next), prev);
+  if (free_head[k] == NIL)
+    avail &= ~(1u << k);
+  freemap[MAP_IDX(off)] &= ~MAP_BIT(off);
+}
+
+/*
+ * free_block - Merge the block at off with free buddies of the same
+ *              order, then return it to the frontier or a free list
+ */
+static void free_block(size_t off, int k) {
+  while (k < MAX_ORDER) {
+    size_t buddy = off ^ (1UL << k);
+    if (buddy >= frontier || !is_free_order(buddy, k))
+      break;
+    unlink_block(buddy, k);
+    off &= ~(1UL << k);
+    k++;
+  }
+  if (off + (1UL << k) == frontier)
+    frontier = off;
+  else
+    push(off, k);
+}
+
+/**************************************
+ * CHECK heap functions
+ *
+ *************************************/
+
+void mm_checkheap(int lineno) {
+  size_t off = START_OFF;
+  unsigned int nfree[MAX_ORDER + 1];
+  int k;
+
+  memset(nfree, 0, sizeof(nfree));
+  /* walk every block below the frontier */
+  while (off < frontier) {
+    k = ORDER(off);
+    if (k < MIN_ORDER || k > MAX_ORDER || off % (1UL << k)) {
+      printf("line %d: bad block at offset %zu\n", lineno, off);
+      return;
+    }
+    if (!IS_ALLOC(off)) {
+      size_t buddy = off ^ (1UL << k);
+      if (!(freemap[MAP_IDX(off)] & MAP_BIT(off)))
+        printf("line %d: free block %zu missing from bitmap\n", lineno, off);
+      if (buddy < frontier && is_free_order(buddy, k))
+        printf("line %d: free buddies %zu and %zu not merged\n", lineno, off,
+               buddy);
+      nfree[k]++;
+    } else if (freemap[MAP_IDX(off)] & MAP_BIT(off)) {
+      printf("line %d: allocated block %zu marked free\n", lineno, off);
+    }
+    off += 1UL << k;
+  }
+  if (off != frontier)
+    printf("line %d: blocks overrun the frontier\n", lineno);
+  /* every free block is on the list of its order */
+  for (k = MIN_ORDER; k <= MAX_ORDER; k++) {
+    unsigned int n = 0, p;
+    for (p = free_head[k]; p != NIL; p = GET(NEXT(p)))
+      n++;
+    if (n != nfree[k])
+      printf("line %d: free list %d has %u blocks, heap has %u\n", lineno, k,
+             n, nfree[k]);
+    if (!(avail & (1u << k)) != (free_head[k] == NIL))
+      printf("line %d: avail bit %d is wrong\n", lineno, k);
+  }
+}
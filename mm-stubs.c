@@ -0,0 +1,50 @@
+/*
+ * mm-stubs.c - Weak defaults for the optional mm entry points used by
+ *     the driver. A malloc package that does not implement lifetime
+ *     hints, scavenging or movable handles still links against mdriver;
+ *     hints are ignored, scavenging, the page heap, line alignment,
+ *     the copy engine and adaptive switches do nothing and handles
+ *     cannot be allocated. The definitions in mm.c override these.
+ */
+#include <stdio.h>
+
+#include "mm.h"
+
+/* do not change the following! */
+#ifdef DRIVER
+/* create aliases for driver tests */
+#define malloc mm_malloc
+#define free mm_free
+#define realloc mm_realloc
+#define calloc mm_calloc
+#endif /* def DRIVER */
+
+#define WEAK __attribute__((weak))
+
+WEAK void *mm_malloc_hint(size_t size, int hint) { return malloc(size); }
+
+WEAK size_t mm_meta_peak(void) { return 0; }
+
+WEAK size_t mm_scavenge(void) { return 0; }
+
+WEAK void mm_set_scavenge(int enable) {}
+
+WEAK void mm_set_pageheap(int enable) {}
+
+WEAK void mm_set_linealign(int enable) {}
+
+WEAK void mm_set_widecopy(int enable) {}
+
+WEAK void mm_set_adaptive(int enable) {}
+
+WEAK mm_handle_t mm_halloc(size_t size) { return 0; }
+
+WEAK void mm_hfree(mm_handle_t h) {}
+
+WEAK int mm_hrealloc(mm_handle_t h, size_t size) { return -1; }
+
+WEAK void *mm_hlock(mm_handle_t h) { return NULL; }
+
+WEAK void mm_hunlock(mm_handle_t h) {}
+
+WEAK size_t mm_compact(size_t maxmoves) { return 0; }
@@ -0,0 +1,409 @@
+/*
+ * mm-tlsf.c
+ * two-level segregated fit (TLSF) allocator over memlib:
+ * 1) blocks have the same layout as in mm.c: a 4 byte header and footer
+ *    holding size and allocated bit, free blocks also hold next/prev
+ *    offsets of their free list, at least 4 * 4 bytes;
+ * 2) free blocks are kept in FL_COUNT * SL_COUNT segregated lists. The
+ *    first level splits sizes by power of two, the second level splits
+ *    each power of two into SL_COUNT equal ranges. Sizes below SMALL_SIZE
+ *    map linearly into first level 0;
+ * 3) one bitmap marks the non-empty first levels and one bitmap per first
+ *    level marks its non-empty lists, so a fit is found with two bit scans
+ *    and malloc and free take a bounded number of steps whatever the
+ *    state of the heap;
+ * 4) a request is rounded up to the start of the next list, so any block
+ *    on a list found by the bit scans fits without searching the list.
+ */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "memlib.h"
+#include "mm.h"
+
+/* do not change the following! */
+#ifdef DRIVER
+/* create aliases for driver tests */
+#define malloc mm_malloc
+#define free mm_free
+#define realloc mm_realloc
+#define calloc mm_calloc
+#endif /* def DRIVER */
+
+/* Basic constants and macros */
+#define WSIZE 4             /* Word and header/footer size (bytes) */
+#define DSIZE 8             /* Double word size (bytes) */
+#define CHUNKSIZE (1 << 12) /* Extend heap by this amount (bytes) */
+
+#define MAX(x, y) ((x) > (y) ? (x) : (y))
+
+/* Segregated list geometry */
+#define SL_SHIFT 4                        /* log2 of lists per first level */
+#define SL_COUNT (1 << SL_SHIFT)          /* Lists per first level */
+#define FL_SHIFT (SL_SHIFT + 3)           /* Sizes are multiples of 8 */
+#define SMALL_SIZE (1 << FL_SHIFT)        /* Below this, lists are linear */
+#define FL_COUNT (27 - FL_SHIFT + 2)      /* Up to 128 MB, above MAX_HEAP */
+
+/* Pack a size and allocated bit into a word */
+#define PACK(size, alloc) ((size) | (alloc))
+
+/* Read and write a word at address p */
+#define GET(p) (*(unsigned int *)(p))
+#define PUT(p, val) (*(unsigned int *)(p) = (val))
+/* Read the size and allocated fields from address p */
+#define GET_SIZE(p) (GET(p) & ~0x7)
+#define GET_ALLOC(p) (GET(p) & 0x1)
+
+/* Given block ptr bp, compute address of its header and footer */
+#define HDRP(bp) ((char *)(bp)-WSIZE)
+#define FTRP(bp) ((char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
+
+/* Free list links are offsets from heap_listp, 0 ends a list */
+#define NEXT_FRBP(bp) (bp)
+#define PREV_FRBP(bp) ((char *)(bp) + WSIZE)
+#define OFF(bp) ((unsigned int)((char *)(bp)-heap_listp))
+#define BLKP(off) (heap_listp + (off))
+
+/* Given block ptr bp, compute address of next and previous blocks */
+#define NEXT_BLKP(bp) ((char *)(bp) + GET_SIZE(((char *)(bp)-WSIZE)))
+#define PREV_BLKP(bp) ((char *)(bp)-GET_SIZE(((char *)(bp)-DSIZE)))
+
+/* Global variables */
+static char *heap_listp = 0;                     /* Pointer to first block */
+static unsigned int fl_bitmap = 0;               /* Non-empty first levels */
+static unsigned int sl_bitmap[FL_COUNT];         /* Non-empty lists */
+static unsigned int blocks[FL_COUNT][SL_COUNT];  /* Heads of the lists */
+
+/* Function prototypes for internal helper routines */
+static void *extend_heap(size_t words);
+static void place(void *bp, size_t asize);
+static void *find_fit(size_t asize);
+static void *coalesce(void *bp);
+static void mapping(size_t size, int *fl, int *sl);
+static void add_free_block(void *bp);
+static void delete_free_block(void *bp);
+
+/*
+ * Initialize: return -1 on error, 0 on success.
+ */
+int mm_init(void) {
+  /* Create the initial empty heap */
+  if ((heap_listp = mem_sbrk(4 * WSIZE)) == (void *)-1)
+    return -1;
+  PUT(heap_listp, 0);                            /* Alignment padding */
+  PUT(heap_listp + (1 * WSIZE), PACK(DSIZE, 1)); /* Prologue header */
+  PUT(heap_listp + (2 * WSIZE), PACK(DSIZE, 1)); /* Prologue footer */
+  PUT(heap_listp + (3 * WSIZE), PACK(0, 1));     /* Epilogue header */
+  heap_listp += (2 * WSIZE);
+  fl_bitmap = 0;
+  memset(sl_bitmap, 0, sizeof(sl_bitmap));
+  memset(blocks, 0, sizeof(blocks));
+  /* Extend the empty heap with a free block of CHUNKSIZE bytes */
+  if (extend_heap(CHUNKSIZE / WSIZE) == NULL)
+    return -1;
+  return 0;
+}
+
+/*
+ * malloc - Allocate a block with at least size bytes of payload
+ */
+void *mm_malloc(size_t size) {
+  size_t asize;      /* Adjusted block size */
+  size_t extendsize; /* Amount to extend heap if no fit */
+  char *bp;
+  if (heap_listp == 0) {
+    mm_init();
+  }
+  /* Ignore spurious requests */
+  if (size == 0)
+    return NULL;
+
+  /* Adjust block size to include overhead and alignment reqs. */
+  if (size <= DSIZE)
+    asize = 2 * DSIZE;
+  else
+    asize = DSIZE * ((size + (DSIZE) + (DSIZE - 1)) / DSIZE);
+
+  /* Search the free lists for a fit */
+  if ((bp = find_fit(asize)) != NULL) {
+    place(bp, asize);
+    return bp;
+  }
+
+  /* No fit found. Get more memory and place the block */
+  extendsize = MAX(asize, CHUNKSIZE);
+  if ((bp = extend_heap(extendsize / WSIZE)) == NULL)
+    return NULL;
+  place(bp, asize);
+  return bp;
+}
+
+/*
+ * free - Free a block
+ */
+void mm_free(void *bp) {
+  if (bp == 0)
+    return;
+  size_t size = GET_SIZE(HDRP(bp));
+  if (heap_listp == 0) {
+    mm_init();
+  }
+
+  PUT(HDRP(bp), PACK(size, 0));
+  PUT(FTRP(bp), PACK(size, 0));
+  add_free_block(coalesce(bp));
+}
+
+/*
+ * realloc - Shrink or grow the block in place when the next block is
+ *           free, otherwise fall back to malloc, copy and free
+ */
+void *mm_realloc(void *ptr, size_t size) {
+  size_t asize, csize, oldsize;
+  void *newptr;
+
+  /* If size == 0 then this is just free, and we return NULL. */
+  if (size == 0) {
+    mm_free(ptr);
+    return 0;
+  }
+
+  /* If oldptr is NULL, then this is just malloc. */
+  if (ptr == NULL) {
+    return mm_malloc(size);
+  }
+
+  asize = size <= DSIZE ? 2 * DSIZE
+                        : DSIZE * ((size + (DSIZE) + (DSIZE - 1)) / DSIZE);
+  csize = GET_SIZE(HDRP(ptr));
+  if (!GET_ALLOC(HDRP(NEXT_BLKP(ptr))))
+    csize += GET_SIZE(HDRP(NEXT_BLKP(ptr)));
+  if (csize >= asize) {
+    if (csize != GET_SIZE(HDRP(ptr)))
+      delete_free_block(NEXT_BLKP(ptr));
+    /* the remainder, if any, has an allocated block after it */
+    if (csize - asize >= 2 * DSIZE) {
+      PUT(HDRP(ptr), PACK(asize, 1));
+      PUT(FTRP(ptr), PACK(asize, 1));
+      newptr = NEXT_BLKP(ptr);
+      PUT(HDRP(newptr), PACK(csize - asize, 0));
+      PUT(FTRP(newptr), PACK(csize - asize, 0));
+      add_free_block(newptr);
+    } else {
+      PUT(HDRP(ptr), PACK(csize, 1));
+      PUT(FTRP(ptr), PACK(csize, 1));
+    }
+    return ptr;
+  }
+
+  newptr = mm_malloc(size);
+
+  /* If realloc() fails the original block is left untouched  */
+  if (!newptr) {
+    return 0;
+  }
+
+  /* Copy the old data. */
+  oldsize = GET_SIZE(HDRP(ptr)) - DSIZE;
+  if (size < oldsize)
+    oldsize = size;
+  memcpy(newptr, ptr, oldsize);
+
+  /* Free the old block. */
+  mm_free(ptr);
+
+  return newptr;
+}
+
+/*
+ * The remaining routines are internal helper routines
+ */
+
+/*
+ * extend_heap - Extend heap with free block and return its block pointer
+ */
+static void *extend_heap(size_t words) {
+  char *bp;
+  size_t size;
+
+  /* Allocate an even number of words to maintain alignment */
+  size = (words % 2) ? (words + 1) * WSIZE : words * WSIZE;
+  if ((long)(bp = mem_sbrk(size)) == -1)
+    return NULL;
+  /* Initialize free block header/footer and the epilogue header */
+  PUT(HDRP(bp), PACK(size, 0));         /* Free block header */
+  PUT(FTRP(bp), PACK(size, 0));         /* Free block footer */
+  PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /* New epilogue header */
+  /* Coalesce if the previous block was free */
+  bp = coalesce(bp);
+  add_free_block(bp);
+  return bp;
+}
+
+/*
+ * coalesce - Boundary tag coalescing. Merge bp with its free neighbours,
+ *            taking them off their lists. Return ptr to coalesced block,
+ *            which is on no list.
+ */
+static void *coalesce(void *bp) {
+  size_t size = GET_SIZE(HDRP(bp));
+
+  if (!GET_ALLOC(HDRP(NEXT_BLKP(bp)))) {
+    delete_free_block(NEXT_BLKP(bp));
+    size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
+    PUT(HDRP(bp), PACK(size, 0));
+    PUT(FTRP(bp), PACK(size, 0));
+  }
+  if (!GET_ALLOC(HDRP(PREV_BLKP(bp)))) {
+    bp = PREV_BLKP(bp);
+    delete_free_block(bp);
+    size += GET_SIZE(HDRP(bp));
+    PUT(HDRP(bp), PACK(size, 0));
+    PUT(FTRP(bp), PACK(size, 0));
+  }
+  return bp;
+}
+
+/*
+ * place - Place block of asize bytes at start of free block bp
+ *         and split if remainder would be at least minimum block size
+ */
+static void place(void *bp, size_t asize) {
+  size_t csize = GET_SIZE(HDRP(bp));
+  delete_free_block(bp);
+  if ((csize - asize) >= (2 * DSIZE)) {
+    PUT(HDRP(bp), PACK(asize, 1));
+    PUT(FTRP(bp), PACK(asize, 1));
+    bp = NEXT_BLKP(bp);
+    PUT(HDRP(bp), PACK(csize - asize, 0));
+    PUT(FTRP(bp), PACK(csize - asize, 0));
+    add_free_block(bp);
+  } else {
+    PUT(HDRP(bp), PACK(csize, 1));
+    PUT(FTRP(bp), PACK(csize, 1));
+  }
+}
+
+/*
+ * mapping - Compute the first and second level list of a block size
+ */
+static void mapping(size_t size, int *fl, int *sl) {
+  int msb;
+  if (size < SMALL_SIZE) {
+    *fl = 0;
+    *sl = size / (SMALL_SIZE / SL_COUNT);
+  } else {
+    msb = 63 - __builtin_clzl(size);
+    *fl = msb - FL_SHIFT + 1;
+    *sl = (size >> (msb - SL_SHIFT)) ^ SL_COUNT;
+  }
+}
+
+/*
+ * find_fit - Find a free block of at least asize bytes. The size is
+ *            rounded up to the next list first so that the head of any
+ *            non-empty list at or above it fits.
+ */
+static void *find_fit(size_t asize) {
+  int fl, sl;
+  unsigned int map;
+  if (asize >= SMALL_SIZE)
+    asize += (1UL << (63 - __builtin_clzl(asize) - SL_SHIFT)) - 1;
+  mapping(asize, &fl, &sl);
+  if (fl >= FL_COUNT)
+    return NULL;
+  map = sl_bitmap[fl] & (~0u << sl);
+  if (map == 0) {
+    if (fl + 1 >= FL_COUNT || (map = fl_bitmap & (~0u << (fl + 1))) == 0)
+      return NULL;
+    fl = __builtin_ctz(map);
+    map = sl_bitmap[fl];
+  }
+  sl = __builtin_ctz(map);
+  return BLKP(blocks[fl][sl]);
+}
+
+/* put a free block at the head of the list of its size
+ */
+static void add_free_block(void *bp) {
+  int fl, sl;
+  unsigned int head;
+  mapping(GET_SIZE(HDRP(bp)), &fl, &sl);
+  head = blocks[fl][sl];
+  PUT(NEXT_FRBP(bp), head);
+  PUT(PREV_FRBP(bp), 0);
+  if (head)
+    PUT(PREV_FRBP(BLKP(head)), OFF(bp));
+  blocks[fl][sl] = OFF(bp);
+  fl_bitmap |= 1u << fl;
+  sl_bitmap[fl] |= 1u << sl;
+}
+
+/* take a free block off the list of its size
+ */
+static void delete_free_block(void *bp) {
+  int fl, sl;
+  unsigned int next = GET(NEXT_FRBP(bp));
+  unsigned int prev = GET(PREV_FRBP(bp));
+  mapping(GET_SIZE(HDRP(bp)), &fl, &sl);
+  if (next)
+    PUT(PREV_FRBP(BLKP(next)), prev);
+  if (prev) {
+    PUT(NEXT_FRBP(BLKP(prev)), next);
+  } else if ((blocks[fl][sl] = next) == 0) {
+    sl_bitmap[fl] &= ~(1u << sl);
+    if (sl_bitmap[fl] == 0)
+      fl_bitmap &= ~(1u << fl);
+  }
+}
+
+/**************************************
+ * CHECK heap functions
+ *
+ *************************************/
+
+void mm_checkheap(int lineno) {
+  char *p = heap_listp;
+  unsigned int nfree = 0, nlisted = 0, off;
+  int fl, sl, f, s;
+
+  /* walk the blocks */
+  while (GET_SIZE(HDRP(p = NEXT_BLKP(p)))) {
+    if ((size_t)p % DSIZE)
+      printf("line %d: block %p is not aligned\n", lineno, p);
+    if (GET(HDRP(p)) != GET(FTRP(p)))
+      printf("line %d: block %p header and footer differ\n", lineno, p);
+    if (!GET_ALLOC(HDRP(p))) {
+      nfree++;
+      if (!GET_ALLOC(HDRP(NEXT_BLKP(p))))
+        printf("line %d: free blocks %p and its next not merged\n", lineno,
+               p);
+    }
+  }
+  if ((void *)HDRP(p) != mem_heap_hi() - WSIZE + 1)
+    printf("line %d: epilogue is not at the end of the heap\n", lineno);
+
+  /* walk the lists */
+  for (f = 0; f < FL_COUNT; f++) {
+    if (!(fl_bitmap & (1u << f)) != (sl_bitmap[f] == 0))
+      printf("line %d: first level bit %d is wrong\n", lineno, f);
+    for (s = 0; s < SL_COUNT; s++) {
+      if (!(sl_bitmap[f] & (1u << s)) != (blocks[f][s] == 0))
+        printf("line %d: second level bit %d/%d is wrong\n", lineno, f, s);
+      for (off = blocks[f][s]; off; off = GET(NEXT_FRBP(BLKP(off)))) {
+        nlisted++;
+        if (GET_ALLOC(HDRP(BLKP(off))))
+          printf("line %d: allocated block on list %d/%d\n", lineno, f, s);
+        mapping(GET_SIZE(HDRP(BLKP(off))), &fl, &sl);
+        if (fl != f || sl != s)
+          printf("line %d: block on list %d/%d belongs on %d/%d\n", lineno, f,
+                 s, fl, sl);
+      }
+    }
+  }
+  if (nfree != nlisted)
+    printf("line %d: %u free blocks, %u on lists\n", lineno, nfree, nlisted);
+}
@@ -5,14 +5,96 @@
  * 1) applies explict list for free blocks;
  * 2) a free block consists of header, prev, next, footer; at least 4 * 4 bytes;
  * 3) an allocated block consists of header and payload and footer;
+ * 4) large free blocks carry an idle stamp after prev; a periodic scavenge
+ *    pass hands the pages inside long-idle ones back to the OS;
+ * 5) every block belongs to a lifetime region (bit 1 of its tags). Each
+ *    region has its own free list and chunks, and blocks of different
+ *    regions never coalesce, so short-lived churn does not pin long-lived
+ *    blocks;
+ * 6) blocks allocated through handles are movable (bit 2 of the tags); their
+ *    handle and lock count stay in the handle table, which maps the offset
+ *    of each such block back to its handle. mm_compact slides unlocked
+ *    movable blocks down into the free block before them, lifts the last
+ *    ones into holes lower in the heap and trims the free tail of it;
+ * 7) realloc moves a block of at least REMAP_MIN bytes to a new block at the
+ *    same offset within a page, so the whole pages of its payload are
+ *    remapped instead of copied;
+ * 8) all state of a heap lives in an mm_heap_t. mm_malloc and friends use
+ *    the default heap over the memlib heap; mm_heap_create makes more heaps,
+ *    each in its own memlib region and at the start of it;
+ * 9) with the page heap on, requests of PH_MINSIZE to PH_MAXSIZE bytes are
+ *    served from spans: runs of whole pages carved from page-aligned
+ *    chunks, which are plain allocated blocks of the heap. A span holds
+ *    one run-sized object or is sliced into objects of one class, and a
+ *    radix tree maps every page to its span, so free finds the metadata
+ *    of such an object without an in-band header;
+ * 10) with line alignment on, a request of LINE_SIZE bytes or more gets a
+ *    payload that starts on a cache line, and the block with its tags
+ *    fills whole lines, so no other payload shares a line with it and the
+ *    block after it is aligned too. Slack in front of a misaligned fit is
+ *    split off as a small free block that tiny requests can use;
+ * 11) blocks moved by realloc are copied by wide_copy, which picks its
+ *    method by size: word moves inline for tiny blocks, 32- or 64-byte
+ *    vector moves (AVX2 or AVX-512, whichever the CPU has, found out on
+ *    first use) for the rest, and non-temporal stores for copies larger
+ *    than the L2 cache, so a large copy the caller may never read again
+ *    does not evict the rest of the cache.
+ * 12) in adaptive mode the heap watches cheap signals of the requests it
+ *    gets, window by window: the entropy of the sizes, the share of
+ *    reallocs, how often mallocs and frees take turns and how much of the
+ *    heap is free. From them it picks the fit (good or first), the
+ *    end of a free block small requests are split from, whether small
+ *    freed blocks wait on quick lists before they are coalesced and
+ *    whether realloc grows blocks in place. A new set of policies is only
+ *    taken after it won ADAPT_HOLD windows in a row.
+ * 13) a heap made in a file backed region (mem_region_open) is in the
+ *    file the next time it is opened. mm_heap_open finds the heap state
+ *    at the start of the region and, if the file is mapped at another
+ *    address than before, moves the few pointers in it along; the free
+ *    list links are offsets already. The application finds its data
+ *    through a root kept as an offset from the region start.
+ * 14) a heap in shared memory (mem_region_shm) is used by several
+ *    processes at once, each mapping it at an address of its own. Its
+ *    state in the region holds offsets only, next to a robust, process
+ *    shared mutex. A process works on a view of the heap in its own
+ *    memory, which takes the offsets in when it locks the heap and puts
+ *    them back before it unlocks. If a process dies holding the lock,
+ *    the next one rebuilds the free lists from the block tags.
+ * 15) under a soft limit (mm_set_soft_limit) a request that would grow
+ *    the default heap past it first makes the heap coalesce its quick
+ *    lists and release the pages of its free blocks, then calls the
+ *    reclaim callbacks of the application one by one, trying to fit the
+ *    request after each stage. Only then does the heap grow, by as little
+ *    as it can, or the request fails if the region is full. Statistics
+ *    count how often each stage ran and how often it was enough.
+ * 16) mm_reserve grows the heap ahead of time, splits the new space into
+ *    blocks of one size class and faults their pages in. The blocks stay
+ *    marked allocated on a reserve list of the class, which malloc takes
+ *    them from before it looks anywhere else, so the first requests of a
+ *    hot size neither search, split, grow the heap nor fault. The lists
+ *    are only given back under the soft limit or when mm_compact runs,
+ *    and are passed over while blocks are line-aligned.
+ *    mm_reserve_bytes faults in a free block of the given size instead.
+ * 17) mm_malloc_fast in mm.h works the block size of a small request out
+ *    at compile time when the size is a constant, and calls
+ *    mm_malloc_class, which goes straight to the reserve and quick lists
+ *    of that class and then to the free list search, past the size
+ *    rounding and the checks for the page heap and empty requests.
  *
  */
 #include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
 #include "memlib.h"
 #include "mm.h"
 
@@ -46,9 +128,17 @@
 #define CHUNKSIZE (1 << 12) /* Extend heap by this amount (bytes) */
 
 #define MAX(x, y) ((x) > (y) ? (x) : (y))
+#define MIN(x, y) ((x) < (y) ? (x) : (y))
+
+/* Block size for a request of size bytes, with tags and alignment */
+#define ADJUST(size)                                                           \
+  ((size) <= DSIZE ? 2 * DSIZE                                                 \
+                   : DSIZE * (((size) + (DSIZE) + (DSIZE - 1)) / DSIZE))
 
 /* Pack a size and allocated bit into a word */
 #define PACK(size, alloc) ((size) | (alloc))
+/* Pack a size, lifetime region and allocated bit into a word */
+#define PACKR(size, region, alloc) ((size) | (region) | (alloc))
 
 /* Read and write a word at address p */
 #define GET(p) (*(unsigned int *)(p))
@@ -57,83 +147,339 @@
 /* Read the size and allocated fields from address p */
 #define GET_SIZE(p) (GET(p) & ~0x7)
 #define GET_ALLOC(p) (GET(p) & 0x1)
+#define GET_REGION(p) (GET(p) & 0x2)
+#define GET_MOVABLE(p) (GET(p) & 0x4)
+#define MOVABLE 0x4
+
+/* Lifetime regions, the index of a region is its tag bit shifted down */
+#define REGION_LONG 0x0
+#define REGION_SHORT 0x2
+#define NREGIONS 2
+#define FR_LIST(heap, region) (heap)->fr_listp[(region) >> 1]
 
 /* Given block ptr bp, compute address of its header and footer */
 #define HDRP(bp) ((char *)(bp)-WSIZE)
 #define FTRP(bp) ((char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
 
+/* Keep the compiler from moving tag stores across it, so a process that
+ * dies halfway leaves them in program order, see shared_recover */
+#define TAG_FENCE() __atomic_signal_fence(__ATOMIC_SEQ_CST)
+
 #define NEXT_FRBP(bp) (bp)
 #define PREV_FRBP(bp) ((char *)(bp) + WSIZE)
+/* Idle stamp of a free block, only present if it is at least SCAV_MINSIZE */
+#define STAMP(bp) ((char *)(bp) + DSIZE)
+
+/* Scavenger tuning, time is counted in calls to free */
+#define SCAV_MINSIZE (1 << 14)  /* Smallest free block worth scavenging */
+#define SCAV_INTERVAL (1 << 10) /* Run a scavenge pass every this many frees */
+#define SCAV_AGE (1 << 12)      /* Frees a block must stay idle before release */
+#define SCAV_DONE 0             /* Stamp of a block whose pages are released */
+
+/* Payloads this large are moved by remapping their pages in realloc */
+#define REMAP_MIN (1 << 20)
+
+/* Copy engine thresholds (bytes) */
+#define COPY_WIDE_MIN 64          /* Smaller copies are done inline */
+#define COPY_STREAM_MIN (1 << 21) /* Larger copies bypass the cache, if
+                                     the L2 cache size is unknown */
+
+/* Cache line size for line-aligned allocations */
+#define LINE_SIZE 64
+#define LINE_ALIGN(size) (((size) + (LINE_SIZE - 1)) & ~(size_t)(LINE_SIZE - 1))
+
+/* Adaptive policy tuning, see the adaptive policy section */
+#define ADAPT_WINDOW 256  /* Requests between two looks at the signals */
+#define ADAPT_HOLD 2      /* Windows new policies must win before use */
+#define ADAPT_BUCKETS 64  /* Buckets of the size histogram */
+#define FIT_SLACK 256     /* A good fit wastes less than this (bytes) */
+#define QL_MAX 128        /* Largest block kept on a quick list (bytes) */
+#define QL_CLASSES (QL_MAX / DSIZE + 1)
+#define QL_BYTES (1 << 16) /* Most bytes held on the quick lists */
+
+/* Policies of the adaptive mode, all 0 is the fixed default */
+#define FIT_GOOD 0    /* Smallest fit, stop at one within FIT_SLACK */
+#define FIT_FIRST 1   /* First fit */
+#define SPLIT_LOW 0   /* Allocate at the start of a free block */
+#define SPLIT_SIZED 1 /* Requests below the mean size go to its end */
+
+/* Kinds of requests counted by adapt_note */
+#define ADAPT_MALLOC 0
+#define ADAPT_FREE 1
+#define ADAPT_REALLOC 2
+
+/* Page heap geometry, see the page heap section */
+#define PH_SHIFT 12                /* log2 of the page size */
+#define PH_PAGE (1 << PH_SHIFT)    /* Page size (bytes) */
+#define PH_MINSIZE (1 << 10)       /* Smallest request served by spans */
+#define PH_MAXSIZE (1 << 18)       /* Largest request served by spans */
+#define PH_SLICE_MAX (1 << 14)     /* Larger requests get a run of pages */
+#define PH_SPAN_BYTES (1 << 14)    /* Sliced spans hold at least this */
+#define PH_CHUNK_PAGES 16          /* Pages taken from the heap at least */
+#define PH_NCLASSES 17             /* Four classes per power of two */
+#define PH_RUN PH_NCLASSES         /* Class of a span holding one run */
+#define PH_FREE (PH_NCLASSES + 1)  /* Class of a free span */
+#define PH_BINS 65                 /* Free span lists by length, last: longer */
+#define PH_BIN(npages) MIN((npages), PH_BINS - 1)
+
+/* A run of pages in the page heap */
+typedef struct span {
+  unsigned int start;       /* First page, counted from the region start */
+  unsigned int npages;      /* Length in pages */
+  unsigned int cls;         /* Object class, PH_RUN or PH_FREE */
+  unsigned int nfree;       /* Free objects of a sliced span */
+  char *objs;               /* List of those free objects */
+  struct span *next, *prev; /* Free or partial span list it is on */
+} span_t;
+
+
+/* A set of policies of the adaptive mode */
+typedef struct policy {
+  unsigned char fit;   /* FIT_GOOD or FIT_FIRST */
+  unsigned char split; /* SPLIT_LOW or SPLIT_SIZED */
+  unsigned char quick; /* Keep small freed blocks on quick lists */
+  unsigned char grow;  /* Let realloc grow blocks in place */
+} policy_t;
+
+/* Workload signals of a heap and the policies they picked */
+typedef struct adapt {
+  unsigned int ops;      /* Requests in the current window */
+  unsigned int sized;    /* Mallocs and reallocs among them */
+  unsigned int reallocs; /* Reallocs among them */
+  unsigned int turns;    /* Requests of another kind than the one before */
+  unsigned int small;    /* Sized requests below half the mean so far */
+  int last_free;         /* The request before was a free */
+  size_t size_sum;       /* Sum of the block sizes asked for */
+  size_t mean;           /* Mean block size of the last window */
+  size_t alloc_bytes;    /* Bytes of the allocated blocks in the heap */
+  unsigned short hist[ADAPT_BUCKETS]; /* Sized requests per bucket */
+  policy_t cur;          /* Policies in force */
+  policy_t next;         /* Policies the signals picked last */
+  unsigned int streak;   /* Windows in a row they were picked */
+} adapt_t;
 
 /* Given block ptr bp, compute address of next and previous blocks */
 #define NEXT_BLKP(bp) ((char *)(bp) + GET_SIZE(((char *)(bp)-WSIZE)))
 #define PREV_BLKP(bp) ((char *)(bp)-GET_SIZE(((char *)(bp)-DSIZE)))
 
+#define RESERVE_CLASSES 16 /* Size classes mm_reserve can hold blocks of */
+
+/* Blocks mm_reserve set aside for one size class */
+typedef struct reserve {
+  size_t asize; /* Block size, 0 if the slot is unused */
+  char *list;   /* Blocks, still marked allocated, linked through payloads */
+} reserve_t;
+
+/* Reclaim callbacks a soft limit can have */
+#define RECLAIM_MAX 8
+
+/* Soft limit of the default heap, its callbacks and their statistics */
+typedef struct soft_limit {
+  size_t limit;                        /* Heap size to stay under, 0: none */
+  mm_reclaim_fn reclaim[RECLAIM_MAX];  /* Callbacks, called in order */
+  int nreclaim;                        /* Number of them */
+  int busy;                            /* In a callback, do not recurse */
+  mm_limit_stats_t st;                 /* Counts of the stages */
+} soft_limit_t;
+
+/* Marks the state of a heap at the start of its region */
+#define HEAP_MAGIC 0x6d6d6870
+
+/* Marks the state of a shared heap at the start of its region */
+#define SHARED_MAGIC 0x6d6d7368
+#define SHARED_VIEWS 16 /* Shared heaps a process can have open */
+
+/* State of a shared heap at the start of its region, offsets from the
+ * region start only */
+typedef struct mm_shared {
+  unsigned int magic;             /* SHARED_MAGIC once the heap is made */
+  unsigned int listp;             /* Offset of the first block */
+  unsigned int fr_list[NREGIONS]; /* Offsets of the free list heads */
+  unsigned int scav_tick;         /* Free clock */
+  size_t root;                    /* Offset of the root object, 0 if none */
+  pthread_mutex_t lock;           /* Robust and process shared */
+} mm_shared_t;
+
+/* State of one heap */
+struct mm_heap {
+  unsigned int magic;           /* HEAP_MAGIC once the heap is made */
+  char *base;                   /* Region start when last opened */
+  size_t root;                  /* Offset of the root object, 0 if none */
+  mem_region_t *mem;            /* memlib region the heap grows in */
+  char *heap_listp;             /* Pointer to first block */
+  char *fr_listp[NREGIONS];     /* Free_list of each region */
+  unsigned int scav_tick;       /* Free clock, never SCAV_DONE */
+  int scav_enabled;             /* Run periodic scavenge passes */
+  unsigned int *htab;           /* Handle table, slot 0 is never used */
+  unsigned int *hrev;           /* Block offset to handle */
+  unsigned int hcap;            /* Number of slots in htab */
+  unsigned int hrcap;           /* Number of entries in hrev */
+  unsigned int hlive;           /* Handles in use */
+  unsigned int hfree;           /* First unused slot, 0 if none */
+  int line_align;               /* Align large enough payloads to lines */
+  int ph_enabled;               /* Serve mid-sized requests from spans */
+  span_t ***pagemap;            /* Radix tree from page to span */
+  span_t *ph_free[PH_BINS];     /* Free spans by length */
+  span_t *ph_partial[PH_NCLASSES]; /* Sliced spans with free objects */
+  int adaptive;                 /* Pick policies by workload phase */
+  adapt_t ad;                   /* Signals and policies of that mode */
+  char *quick[QL_CLASSES];      /* Quick lists of small blocks by size */
+  size_t quick_bytes;           /* Bytes of the blocks on them */
+  mm_shared_t *shared;          /* State in shared memory, NULL if none */
+  reserve_t reserve[RESERVE_CLASSES]; /* Blocks set aside by mm_reserve */
+  size_t reserve_bytes;         /* Bytes of the blocks on them */
+};
+
+/* A copy routine of the engine, for non-overlapping dst and src */
+typedef void (*copy_fn)(char *dst, const char *src, size_t n);
+
 /* Global variables */
-static char *heap_listp = 0; /* Pointer to first block */
-static char *fr_listp = 0;   /* Free_list */
+static mm_heap_t mm_default = {.scav_tick = 1, .scav_enabled = 1};
+static int wide_enabled = 1;    /* Move blocks with wide_copy, not memcpy */
+static copy_fn copy_mid;        /* Vector copy, NULL until set up */
+static copy_fn copy_stream;     /* Copy with non-temporal stores */
+static size_t copy_stream_min;  /* Copies this large use copy_stream */
+static mm_heap_t shared_views[SHARED_VIEWS]; /* Views of shared heaps */
+static mem_region_t *htab_mem;  /* Region of the handle table */
+static mem_region_t *hrev_mem;  /* Region of its reverse map */
+static soft_limit_t soft;       /* Soft limit of the default heap */
 
 /* Function prototypes for internal helper routines */
-static void *extend_heap(size_t words);
-static void place(void *bp, size_t asize);
-static void *find_fit(size_t asize);
-static void *coalesce(void *bp);
+static int heap_init(mm_heap_t *heap);
+static void *extend_heap(mm_heap_t *heap, size_t words, unsigned int region);
+static void place(mm_heap_t *heap, void *bp, size_t asize);
+static void *place_split(mm_heap_t *heap, char *bp, size_t asize);
+static int grow_block(mm_heap_t *heap, char *bp, size_t asize);
+static void *find_fit(mm_heap_t *heap, size_t asize, unsigned int region);
+static void *malloc_region(mm_heap_t *heap, size_t size, unsigned int region);
+static void *malloc_block(mm_heap_t *heap, size_t asize, unsigned int region);
+static void free_block(mm_heap_t *heap, void *bp);
+static void *realloc_block(mm_heap_t *heap, void *ptr, size_t size);
+static void *coalesce(mm_heap_t *heap, void *bp);
+static size_t scavenge(mm_heap_t *heap, unsigned int age);
+static void *slide(mm_heap_t *heap, void *fbp);
+static int lift(mm_heap_t *heap);
+static mm_handle_t block_handle(mm_heap_t *heap, void *bp);
+static void trim_heap(mm_heap_t *heap);
+static void *place_congruent(mm_heap_t *heap, size_t size,
+                             unsigned int region, char *like, size_t align);
+static void move_payload(mm_heap_t *heap, char *dst, char *src, size_t n);
+static void wide_copy(char *dst, const char *src, size_t n);
+static void checkheap(mm_heap_t *heap, int lineno);
+static void *heap_malloc(mm_heap_t *heap, size_t size, unsigned int region);
+static void heap_free(mm_heap_t *heap, void *bp);
+static span_t *pm_get(mm_heap_t *heap, void *bp);
+static void *ph_malloc(mm_heap_t *heap, size_t size);
+static void ph_free(mm_heap_t *heap, span_t *s, void *bp);
+static size_t ph_usable(span_t *s);
+static void adapt_note(mm_heap_t *heap, int kind, size_t size);
+static void adapt_apply(mm_heap_t *heap, policy_t p);
+static int quick_push(mm_heap_t *heap, char *bp);
+static void quick_flush(mm_heap_t *heap);
+static mm_shared_t *shared_make(mm_heap_t *heap);
+static void shared_lock(mm_heap_t *heap);
+static void shared_unlock(mm_heap_t *heap);
+static void *pressure(mm_heap_t *heap, size_t asize, unsigned int region);
+static void *grow_tail(mm_heap_t *heap, size_t asize, unsigned int region);
+static void *reserve_pop(mm_heap_t *heap, size_t asize);
+static void reserve_flush(mm_heap_t *heap);
 
 /* ansistant function */
-static void add_free_block(void *bp);
-static void delete_free_block(void *bp);
+static void add_free_block(mm_heap_t *heap, void *bp);
+static void delete_free_block(mm_heap_t *heap, void *bp);
+
+/* Lock a shared heap around a call, nothing for a private one */
+static inline void heap_enter(mm_heap_t *heap) {
+  if (heap->shared)
+    shared_lock(heap);
+}
+static inline void heap_leave(mm_heap_t *heap) {
+  if (heap->shared)
+    shared_unlock(heap);
+}
 
 /*
  * Initialize: return -1 on error, 0 on success.
  */
 int mm_init(void) {
-  /* Create the initial empty heap */
-  if ((heap_listp = mem_sbrk(4 * WSIZE)) == (void *)-1)
-    return -1;
-  PUT(heap_listp, 0);                            /* Alignment padding */
-  PUT(heap_listp + (1 * WSIZE), PACK(DSIZE, 1)); /* Prologue header */
-  PUT(heap_listp + (2 * WSIZE), PACK(DSIZE, 1)); /* Prologue footer */
-  PUT(heap_listp + (3 * WSIZE), PACK(0, 1));     /* Epilogue header */
-  heap_listp += (2 * WSIZE);
-  fr_listp = 0;
-  /* Extend the empty heap with a free block of CHUNKSIZE bytes */
-  if (extend_heap(CHUNKSIZE / WSIZE) == NULL)
-    return -1;
-  return 0;
+  /* the handle tables start over with the heap */
+  if (htab_mem != NULL)
+    mem_region_reset_brk(htab_mem);
+  if (hrev_mem != NULL)
+    mem_region_reset_brk(hrev_mem);
+  mm_default.mem = mem_default_region();
+  return heap_init(&mm_default);
 }
 
 /*
  * malloc - Allocate a block with at least size bytes of payload
  */
 void *mm_malloc(size_t size) {
-  size_t asize;      /* Adjusted block size */
-  size_t extendsize; /* Amount to extend heap if no fit */
-  char *bp;
-  if (heap_listp == 0) {
+  if (mm_default.heap_listp == 0) {
     mm_init();
   }
-  /* Ignore spurious requests */
-  if (size == 0)
-    return NULL;
+  return heap_malloc(&mm_default, size, REGION_LONG);
+}
 
-  /* Adjust block size to include overhead and alignment reqs. */
-  if (size <= DSIZE)
-    asize = 2 * DSIZE;
-  else
-    asize = DSIZE * ((size + (DSIZE) + (DSIZE - 1)) / DSIZE);
+/*
+ * mm_malloc_class - mm_malloc for a request of 0 < size <= MM_CLASS_MAX
+ *                   bytes whose block size cls * DSIZE was worked out at
+ *                   compile time (see mm_malloc_fast). The quick list of
+ *                   the class comes first, which mm_free_class fills; the
+ *                   page heap is never asked, the request is too small.
+ */
+void *mm_malloc_class(size_t size, unsigned int cls) {
+  mm_heap_t *heap = &mm_default;
+  size_t asize = (size_t)cls * DSIZE;
+  char *bp;
 
-  /* Search the free list for a fit */
-  if ((bp = find_fit(asize)) != NULL) {
-    place(bp, asize);
+  /* nothing is on it while lines are aligned, see mm_set_linealign */
+  if ((bp = heap->quick[cls]) != NULL) {
+    if (heap->adaptive)
+      adapt_note(heap, ADAPT_MALLOC, size);
+    heap->quick[cls] = *(char **)bp;
+    heap->quick_bytes -= asize;
     return bp;
   }
+  if (heap->heap_listp == 0)
+    mm_init();
+  if (heap->adaptive)
+    adapt_note(heap, ADAPT_MALLOC, size);
+  if (heap->reserve_bytes && !heap->line_align &&
+      (bp = reserve_pop(heap, asize)) != NULL)
+    return bp;
+  if (heap->line_align && size >= LINE_SIZE)
+    return place_congruent(heap, LINE_ALIGN(size + DSIZE) - DSIZE,
+                           REGION_LONG, mem_region_lo(heap->mem), LINE_SIZE);
+  return malloc_block(heap, asize, REGION_LONG);
+}
 
-  /* No fit found. Get more memory and place the block */
-  extendsize = MAX(asize, CHUNKSIZE);
-  if ((bp = extend_heap(extendsize / WSIZE)) == NULL)
-    return NULL;
-  place(bp, asize);
-  return bp;
+/*
+ * mm_free_class - mm_free for a block of at most MM_CLASS_MAX bytes (see
+ *                 mm_free_fast): it waits on the quick list of its size
+ *                 for mm_malloc_class whatever the adaptive policies are,
+ *                 as long as the quick lists have room
+ */
+void mm_free_class(void *bp) {
+  mm_heap_t *heap = &mm_default;
+
+  if (bp == 0)
+    return;
+  if (heap->adaptive)
+    adapt_note(heap, ADAPT_FREE, 0);
+  if (!quick_push(heap, bp))
+    free_block(heap, bp);
+}
+
+/*
+ * mm_malloc_hint - Allocate a block in the region matching the expected
+ *                  lifetime of the object (MM_SHORT_LIVED or MM_LONG_LIVED)
+ */
+void *mm_malloc_hint(size_t size, int hint) {
+  if (mm_default.heap_listp == 0) {
+    mm_init();
+  }
+  return mm_heap_malloc_hint(&mm_default, size, hint);
 }
 
 /*
@@ -142,213 +488,2172 @@ void *mm_malloc(size_t size) {
 void mm_free(void *bp) {
   if (bp == 0)
     return;
-  size_t size = GET_SIZE(HDRP(bp));
-  if (heap_listp == 0) {
+  if (mm_default.heap_listp == 0) {
     mm_init();
   }
-
-  PUT(HDRP(bp), PACK(size, 0));
-  PUT(FTRP(bp), PACK(size, 0));
-  coalesce(bp);
+  heap_free(&mm_default, bp);
 }
 
 /*
- * realloc - Naive implementation of realloc
+ * mm_usable_size - Bytes of payload in the allocated block bp, at least
+ *                  the size it was allocated with
  */
-inline void *realloc(void *ptr, size_t size) {
-  size_t oldsize;
-  void *newptr;
-
-  /* If size == 0 then this is just free, and we return NULL. */
-  if (size == 0) {
-    mm_free(ptr);
+size_t mm_usable_size(void *bp) {
+  span_t *s;
+  if (bp == 0)
     return 0;
+  if ((s = pm_get(&mm_default, bp)) != NULL)
+    return ph_usable(s);
+  return GET_SIZE(HDRP(bp)) - DSIZE;
+}
+
+/*
+ * mm_memalign - Allocate a block whose payload starts on a multiple of
+ *               align, a power of two. Return NULL if align is not one.
+ */
+void *mm_memalign(size_t align, size_t size) {
+  if (mm_default.heap_listp == 0) {
+    mm_init();
   }
+  return mm_heap_memalign(&mm_default, align, size);
+}
 
-  /* If oldptr is NULL, then this is just malloc. */
-  if (ptr == NULL) {
-    return mm_malloc(size);
+/*
+ * mm_scavenge - Release the pages of every large free block at once,
+ *               ignoring how long it has been idle. Return bytes released.
+ */
+size_t mm_scavenge(void) { return scavenge(&mm_default, 0); }
+
+/*
+ * mm_set_scavenge - Turn the periodic scavenge pass in free on or off
+ */
+void mm_set_scavenge(int enable) { mm_default.scav_enabled = enable; }
+
+/*
+ * mm_set_pageheap - Serve requests of PH_MINSIZE to PH_MAXSIZE bytes from
+ *                   the page heap or not. Objects already in spans stay
+ *                   there until freed.
+ */
+void mm_set_pageheap(int enable) { mm_default.ph_enabled = enable; }
+
+/*
+ * mm_set_linealign - Start payloads of LINE_SIZE bytes or more on a cache
+ *                    line and pad them to whole lines, or not
+ */
+void mm_set_linealign(int enable) {
+  /* blocks already on the quick lists are not aligned */
+  if (enable)
+    quick_flush(&mm_default);
+  mm_default.line_align = enable;
+}
+
+/*
+ * mm_set_widecopy - Copy moved blocks with the wide copy engine, the
+ *                   default, or with plain memcpy
+ */
+void mm_set_widecopy(int enable) { wide_enabled = enable; }
+
+/*
+ * mm_set_adaptive - Pick the placement policies by workload phase, or
+ *                   keep the fixed default ones
+ */
+void mm_set_adaptive(int enable) {
+  mm_default.adaptive = enable;
+  if (!enable && mm_default.heap_listp) {
+    policy_t fixed = {0};
+    adapt_apply(&mm_default, fixed);
   }
+}
 
-  newptr = mm_malloc(size);
+/*
+ * mm_reserve - Set count blocks for requests of size bytes aside, with
+ *              their pages faulted in, so the next count such requests
+ *              take one of them without a search or a fault. Return -1 if
+ *              the heap cannot hold them or RESERVE_CLASSES other sizes
+ *              have blocks set aside, 0 otherwise.
+ */
+int mm_reserve(size_t size, size_t count) {
+  mm_heap_t *heap = &mm_default;
+  reserve_t *rs = NULL;
+  size_t asize, total, bsize;
+  char *bp;
+  int i;
 
-  /* If realloc() fails the original block is left untouched  */
-  if (!newptr) {
+  if (heap->heap_listp == 0 && mm_init() < 0)
+    return -1;
+  if (size == 0 || count == 0)
     return 0;
+  asize = ADJUST(size);
+  total = asize * count;
+  if (total / count != asize || total > INT_MAX)
+    return -1;
+  for (i = 0; i < RESERVE_CLASSES && rs == NULL; i++)
+    if (heap->reserve[i].asize == asize)
+      rs = &heap->reserve[i];
+  for (i = 0; i < RESERVE_CLASSES && rs == NULL; i++)
+    if (heap->reserve[i].asize == 0)
+      rs = &heap->reserve[i];
+  if (rs == NULL)
+    return -1;
+  if ((bp = find_fit(heap, total, REGION_LONG)) == NULL &&
+      (bp = grow_tail(heap, total, REGION_LONG)) == NULL)
+    return -1;
+  place(heap, bp, total);
+  /* place keeps a remainder too small to be a block, the last block
+   * takes it */
+  total = GET_SIZE(HDRP(bp));
+  mem_prefault(HDRP(bp), total);
+  heap->reserve_bytes += total;
+  /* cut from the end, so the list hands the blocks out in address order */
+  rs->asize = asize;
+  bsize = total - (count - 1) * asize;
+  for (bp += total - bsize; count--; bp -= asize, bsize = asize) {
+    PUT(HDRP(bp), PACK(bsize, 1));
+    PUT(FTRP(bp), PACK(bsize, 1));
+    *(char **)bp = rs->list;
+    rs->list = bp;
   }
+  return 0;
+}
 
-  /* Copy the old data. */
-  oldsize = GET_SIZE(HDRP(ptr));
-  if (size < oldsize)
-    oldsize = size;
-  memcpy(newptr, ptr, oldsize);
+/*
+ * mm_reserve_bytes - Make sure a free block of size bytes is in the heap,
+ *                    growing it if need be, and fault its pages in. The
+ *                    periodic scavenge passes may release them again once
+ *                    the block has been idle for long.
+ */
+int mm_reserve_bytes(size_t size) {
+  mm_heap_t *heap = &mm_default;
+  size_t asize;
+  char *bp;
 
-  /* Free the old block. */
-  mm_free(ptr);
+  if (heap->heap_listp == 0 && mm_init() < 0)
+    return -1;
+  if (size == 0)
+    return 0;
+  asize = ADJUST(size);
+  if (asize > INT_MAX)
+    return -1;
+  if ((bp = find_fit(heap, asize, REGION_LONG)) == NULL &&
+      (bp = grow_tail(heap, asize, REGION_LONG)) == NULL)
+    return -1;
+  mem_prefault(bp, GET_SIZE(HDRP(bp)) - DSIZE);
+  if (GET_SIZE(HDRP(bp)) >= SCAV_MINSIZE)
+    PUT(STAMP(bp), heap->scav_tick);
+  return 0;
+}
 
-  return newptr;
+/*
+ * mm_set_soft_limit - Keep the default heap under bytes (0: no limit) as
+ *                     long as reclaiming memory lets it, and add reclaim,
+ *                     if not NULL, to the callbacks called before it grows
+ *                     past them. Return -1 if there are RECLAIM_MAX
+ *                     callbacks already, 0 otherwise.
+ */
+int mm_set_soft_limit(size_t bytes, mm_reclaim_fn reclaim) {
+  soft.limit = bytes;
+  soft.st.limit = bytes;
+  if (reclaim == NULL)
+    return 0;
+  if (soft.nreclaim == RECLAIM_MAX)
+    return -1;
+  soft.reclaim[soft.nreclaim++] = reclaim;
+  return 0;
 }
 
 /*
- * The remaining routines are internal helper routines
+ * mm_limit_stats - How often the stages of the soft limit ran
  */
+void mm_limit_stats(mm_limit_stats_t *st) { *st = soft.st; }
 
 /*
- * extend_heap - Extend heap with free block and return its block pointer
+ * realloc - Resize a block, moving it if it has to grow
  */
-inline static void *extend_heap(size_t words) {
-  char *bp;
-  size_t size;
+inline void *realloc(void *ptr, size_t size) {
+  return realloc_block(&mm_default, ptr, size);
+}
 
-  /* Allocate an even number of words to maintain alignment */
-  size = (words % 2) ? (words + 1) * WSIZE : words * WSIZE;
-  if ((long)(bp = mem_sbrk(size)) == -1)
+/*
+ * mm_heap_create - Make a heap in the memlib region mem, which must be
+ *                  empty and is not used for anything else. The heap's
+ *                  state is kept at the start of the region. Return NULL
+ *                  on error.
+ */
+mm_heap_t *mm_heap_create(mem_region_t *mem) {
+  mm_heap_t *heap = mem_region_sbrk(mem, ALIGN(sizeof(mm_heap_t)));
+  if (heap == (void *)-1)
     return NULL;
-  /* Initialize free block header/footer and the epilogue header */
-  PUT(HDRP(bp), PACK(size, 0));         /* Free block header */
-  PUT(FTRP(bp), PACK(size, 0));         /* Free block footer */
-  PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /* New epilogue header */
-  /* Coalesce if the previous block was free */
-  return coalesce(bp);
+  memset(heap, 0, sizeof(mm_heap_t));
+  heap->mem = mem;
+  heap->base = (char *)heap;
+  heap->scav_tick = 1;
+  heap->scav_enabled = 1;
+  if (heap_init(heap) < 0)
+    return NULL;
+  heap->magic = HEAP_MAGIC;
+  return heap;
 }
 
 /*
- * coalesce - Boundary tag coalescing. Return ptr to coalesced block
+ * mm_heap_open - The heap that mm_heap_create made in mem before, if mem
+ *                is a file backed region reopened (see memlib.h), or a
+ *                new heap if mem is empty. Pointers stored in blocks are
+ *                only right if the region is mapped at the same address
+ *                as before. Return NULL if mem holds something else, or a
+ *                heap with handles, spans or quick lists, which point
+ *                outside it or are not offsets.
  */
-inline static void *coalesce(void *bp) {
-  size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp)));
-  size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
-  size_t size = GET_SIZE(HDRP(bp));
+mm_heap_t *mm_heap_open(mem_region_t *mem) {
+  mm_heap_t *heap = mem_region_lo(mem);
+  long delta;
+  int i;
 
-  if (prev_alloc && next_alloc) { /* Case 1 */
-    add_free_block(bp);
-  }
+  if (mem_region_size(mem) == 0)
+    return mm_heap_create(mem);
+  if (mem_region_size(mem) < sizeof(mm_heap_t) ||
+      heap->magic != HEAP_MAGIC || heap->htab || heap->pagemap ||
+      heap->quick_bytes || heap->reserve_bytes)
+    return NULL;
+  delta = (char *)heap - heap->base;
+  heap->heap_listp += delta;
+  for (i = 0; i < NREGIONS; i++)
+    if (heap->fr_listp[i] != NULL)
+      heap->fr_listp[i] += delta;
+  heap->base = (char *)heap;
+  heap->mem = mem;
+  return heap;
+}
 
-  else if (prev_alloc && !next_alloc) { /* Case 2 */
-    size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
-    delete_free_block(NEXT_BLKP(bp));
-    PUT(HDRP(bp), PACK(size, 0));
-    PUT(FTRP(bp), PACK(size, 0));
-    add_free_block(bp);
-  }
+/*
+ * mm_heap_shared - A view of the heap in mem, a region in shared memory
+ *                  (see memlib.h), made there if mem is empty. The first
+ *                  process to lock the region makes the heap, the others
+ *                  wait for it. Each process can have SHARED_VIEWS shared
+ *                  heaps open; this call is not thread safe. Return NULL
+ *                  on error or if mem holds something else.
+ */
+mm_heap_t *mm_heap_shared(mem_region_t *mem) {
+  mm_heap_t *heap = NULL;
+  mm_shared_t *sh;
+  int i;
 
-  else if (!prev_alloc && next_alloc) { /* Case 3 */
-    size += GET_SIZE(HDRP(PREV_BLKP(bp)));
-    PUT(FTRP(bp), PACK(size, 0));
-    PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
-    bp = PREV_BLKP(bp);
-  }
+  for (i = 0; i < SHARED_VIEWS && heap == NULL; i++)
+    if (shared_views[i].shared == NULL)
+      heap = &shared_views[i];
+  if (heap == NULL)
+    return NULL;
+  memset(heap, 0, sizeof(mm_heap_t));
+  heap->mem = mem;
+  heap->base = mem_region_lo(mem);
+  heap->scav_tick = 1;
+  heap->scav_enabled = 1;
+  if (mem_region_lock(mem) < 0)
+    return NULL;
+  sh = (mm_shared_t *)heap->base;
+  if (mem_region_size(mem) == 0)
+    sh = shared_make(heap);
+  else if (mem_region_size(mem) < sizeof(mm_shared_t) ||
+           __atomic_load_n(&sh->magic, __ATOMIC_ACQUIRE) != SHARED_MAGIC)
+    sh = NULL; /* something else, or its maker died making it */
+  mem_region_unlock(mem);
+  if (sh == NULL)
+    return NULL;
+  heap->shared = sh;
+  return heap;
+}
 
-  else { /* Case 4 */
-    size += GET_SIZE(HDRP(PREV_BLKP(bp))) + GET_SIZE(FTRP(NEXT_BLKP(bp)));
-    PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
-    PUT(FTRP(NEXT_BLKP(bp)), PACK(size, 0));
-    delete_free_block(NEXT_BLKP(bp));
-    bp = PREV_BLKP(bp);
-  }
+/*
+ * mm_heap_close - Drop the view of a shared heap; the heap stays in its
+ *                 region. Nothing for other heaps.
+ */
+void mm_heap_close(mm_heap_t *heap) {
+  if (heap->shared != NULL && heap >= shared_views &&
+      heap < shared_views + SHARED_VIEWS)
+    heap->shared = NULL;
+}
+
+/*
+ * mm_heap_offset - Offset of bp from the start of the region of heap,
+ *                  which another process can pass to mm_heap_at
+ */
+size_t mm_heap_offset(mm_heap_t *heap, void *bp) {
+  return (size_t)((char *)bp - heap->base);
+}
+
+/*
+ * mm_heap_at - The address of offset off in the region of heap
+ */
+void *mm_heap_at(mm_heap_t *heap, size_t off) { return heap->base + off; }
+
+/*
+ * mm_heap_root - The root object of heap, NULL if none was set
+ */
+void *mm_heap_root(mm_heap_t *heap) {
+  void *root;
+  heap_enter(heap);
+  root = heap->root ? heap->base + heap->root : NULL;
+  heap_leave(heap);
+  return root;
+}
+
+/*
+ * mm_heap_set_root - Make the block at root, or NULL, the root object of
+ *                    heap, which mm_heap_root finds again after a reopen
+ */
+void mm_heap_set_root(mm_heap_t *heap, void *root) {
+  heap_enter(heap);
+  heap->root = root ? (size_t)((char *)root - heap->base) : 0;
+  heap_leave(heap);
+}
+
+/*
+ * mm_heap_malloc - Allocate a block from heap
+ */
+void *mm_heap_malloc(mm_heap_t *heap, size_t size) {
+  void *bp;
+  heap_enter(heap);
+  bp = heap_malloc(heap, size, REGION_LONG);
+  heap_leave(heap);
   return bp;
 }
 
 /*
- * place - Place block of asize bytes at start of free block bp
- *         and split if remainder would be at least minimum block size
+ * mm_heap_malloc_hint - Allocate a block from heap with a lifetime hint
  */
-inline static void place(void *bp, size_t asize) {
-  size_t csize = GET_SIZE(HDRP(bp));
-  if ((csize - asize) >= (2 * DSIZE)) {
-    PUT(HDRP(bp), PACK(asize, 1));
-    PUT(FTRP(bp), PACK(asize, 1));
-    delete_free_block(bp);
-    bp = NEXT_BLKP(bp);
-    PUT(HDRP(bp), PACK(csize - asize, 0));
-    PUT(FTRP(bp), PACK(csize - asize, 0));
-    add_free_block(bp);
-  } else {
-    PUT(HDRP(bp), PACK(csize, 1));
-    PUT(FTRP(bp), PACK(csize, 1));
-    delete_free_block(bp);
-  }
+void *mm_heap_malloc_hint(mm_heap_t *heap, size_t size, int hint) {
+  void *bp;
+  heap_enter(heap);
+  bp = heap_malloc(heap, size,
+                   (hint & MM_SHORT_LIVED) ? REGION_SHORT : REGION_LONG);
+  heap_leave(heap);
+  return bp;
 }
 
 /*
- * find_fit - Find a fit for a block with asize bytes
- * this function uses stategy which find a good block
- * maybe not the best
+ * mm_heap_memalign - mm_memalign for heap
  */
-inline static void *find_fit(size_t asize) {
-  void *bp = NULL;
-  size_t tmp = 1 << 31;
-  void *record = NULL;
-  for (bp = fr_listp; bp != NULL && GET(NEXT_FRBP(bp)) != 0;
-       bp = bp + (int)GET(NEXT_FRBP(bp))) {
-    if (GET_SIZE(HDRP(bp)) >= asize && GET_SIZE(HDRP(bp)) < tmp) {
-      record = bp;
-      tmp = GET_SIZE(HDRP(bp));
-    }
-    if (tmp - asize < 256)
-      return record;
-  }
-  if (bp != NULL && GET_SIZE(HDRP(bp)) >= asize && GET_SIZE(HDRP(bp)) < tmp) {
-    return bp;
-  }
-  return record;
+void *mm_heap_memalign(mm_heap_t *heap, size_t align, size_t size) {
+  void *bp;
+  if (align & (align - 1))
+    return NULL;
+  if (align <= ALIGNMENT)
+    return mm_heap_malloc(heap, size);
+  if (size == 0)
+    return NULL;
+  heap_enter(heap);
+  bp = place_congruent(heap, size, REGION_LONG, NULL, align);
+  heap_leave(heap);
+  return bp;
 }
-/* add a freed block to the free block list
+
+/*
+ * mm_heap_free - Free a block that was allocated from heap
  */
-inline static void add_free_block(void *bp) {
-  if (fr_listp == NULL) {
-    fr_listp = bp;
-    PUT(NEXT_FRBP(bp), 0);
-    PUT(PREV_FRBP(bp), 0);
-  } else {
-    PUT(PREV_FRBP(bp), 0);
-    PUT(NEXT_FRBP(bp), ADDR_SUB(fr_listp, bp));
-    PUT(PREV_FRBP(fr_listp), ADDR_SUB(bp, fr_listp));
-    fr_listp = bp;
-  }
+void mm_heap_free(mm_heap_t *heap, void *bp) {
+  if (bp == 0)
+    return;
+  heap_enter(heap);
+  heap_free(heap, bp);
+  heap_leave(heap);
 }
-/* delete a freed block to the free block list
+
+/*
+ * mm_heap_realloc - Resize a block that was allocated from heap
  */
-inline static void delete_free_block(void *bp) {
-  if (bp == fr_listp) {
-    if (GET(NEXT_FRBP(bp))) {
-      fr_listp = bp + (int)(GET(NEXT_FRBP(bp)));
-      PUT(PREV_FRBP(fr_listp), 0);
-    } else {
-      fr_listp = 0;
-    }
-  } else {
-    if (GET(NEXT_FRBP(bp))) {
-      char *tmp1 = (int)GET(PREV_FRBP(bp)) + bp;
-      char *tmp2 = (int)GET(NEXT_FRBP(bp)) + bp;
-      PUT(NEXT_FRBP(tmp1), ADDR_SUB(tmp2, tmp1));
-      PUT(PREV_FRBP(tmp2), ADDR_SUB(tmp1, tmp2));
-    } else {
-      char *tmp = (int)GET(PREV_FRBP(bp)) + bp;
-      PUT(NEXT_FRBP(tmp), 0);
-    }
-  }
+void *mm_heap_realloc(mm_heap_t *heap, void *ptr, size_t size) {
+  void *bp;
+  heap_enter(heap);
+  bp = realloc_block(heap, ptr, size);
+  heap_leave(heap);
+  return bp;
 }
 
-/**************************************
- * CHECK heap functions
- *
- *************************************/
+/*
+ * mm_heap_scavenge - mm_scavenge for heap
+ */
+size_t mm_heap_scavenge(mm_heap_t *heap) {
+  size_t released;
+  heap_enter(heap);
+  released = scavenge(heap, 0);
+  heap_leave(heap);
+  return released;
+}
 
 /*
- * Return whether the pointer is aligned.
- * May be useful for debugging.
+ * mm_heap_checkheap - mm_checkheap for heap
  */
+void mm_heap_checkheap(mm_heap_t *heap, int lineno) {
+  heap_enter(heap);
+  checkheap(heap, lineno);
+  heap_leave(heap);
+}
 
-void mm_checkheap(int lineno) {
-  /* check heap */
-  printf("check heap\n");
-  char *p = heap_listp;
-  /* Check epilogue block */
-  if (GET_SIZE(HDRP(p)) == DSIZE)
-    printf("epilogue blocks is OK\n");
-  int cnt = 0;
-  while (GET_SIZE(HDRP(p))) {
+/*
+ * The remaining routines are internal helper routines
+ */
+
+/*
+ * heap_init - Create the initial empty heap in the region of heap
+ */
+static int heap_init(mm_heap_t *heap) {
+  char *listp;
+  if ((listp = mem_region_sbrk(heap->mem, 4 * WSIZE)) == (void *)-1)
+    return -1;
+  PUT(listp, 0);                            /* Alignment padding */
+  PUT(listp + (1 * WSIZE), PACK(DSIZE, 1)); /* Prologue header */
+  PUT(listp + (2 * WSIZE), PACK(DSIZE, 1)); /* Prologue footer */
+  PUT(listp + (3 * WSIZE), PACK(0, 1));     /* Epilogue header */
+  heap->heap_listp = listp + (2 * WSIZE);
+  memset(heap->fr_listp, 0, sizeof(heap->fr_listp));
+  heap->htab = 0;
+  heap->hrev = 0;
+  heap->hcap = heap->hrcap = heap->hlive = heap->hfree = 0;
+  heap->pagemap = NULL;
+  memset(heap->ph_free, 0, sizeof(heap->ph_free));
+  memset(heap->ph_partial, 0, sizeof(heap->ph_partial));
+  memset(&heap->ad, 0, sizeof(heap->ad));
+  memset(heap->quick, 0, sizeof(heap->quick));
+  heap->quick_bytes = 0;
+  memset(heap->reserve, 0, sizeof(heap->reserve));
+  heap->reserve_bytes = 0;
+  /* Extend the empty heap with a free block of CHUNKSIZE bytes */
+  if (extend_heap(heap, CHUNKSIZE / WSIZE, REGION_LONG) == NULL)
+    return -1;
+  return 0;
+}
+
+/*
+ * malloc_region - Allocate a block from the given lifetime region
+ */
+static void *malloc_region(mm_heap_t *heap, size_t size, unsigned int region) {
+  /* Ignore spurious requests */
+  if (size == 0)
+    return NULL;
+
+  /* Adjust block size to include overhead and alignment reqs. */
+  return malloc_block(heap, ADJUST(size), region);
+}
+
+/*
+ * malloc_block - Allocate a block of asize bytes, tags included, from the
+ *                given lifetime region
+ */
+static void *malloc_block(mm_heap_t *heap, size_t asize, unsigned int region) {
+  size_t extendsize; /* Amount to extend heap if no fit */
+  char *bp;
+
+  /* Search the free list for a fit */
+  if ((bp = find_fit(heap, asize, region)) != NULL)
+    return place_split(heap, bp, asize);
+
+  /* Coalesce the blocks on the quick lists before the heap grows */
+  if (heap->quick_bytes) {
+    quick_flush(heap);
+    if ((bp = find_fit(heap, asize, region)) != NULL)
+      return place_split(heap, bp, asize);
+  }
+
+  /* No fit found. Get more memory and place the block */
+  extendsize = MAX(asize, CHUNKSIZE);
+  if (heap == &mm_default && soft.limit &&
+      mem_region_size(heap->mem) + extendsize > soft.limit)
+    return pressure(heap, asize, region);
+  if ((bp = extend_heap(heap, extendsize / WSIZE, region)) == NULL)
+    return NULL;
+  return place_split(heap, bp, asize);
+}
+
+/*
+ * free_block - Free a block and run a scavenge pass every SCAV_INTERVAL
+ *              frees
+ */
+static void free_block(mm_heap_t *heap, void *bp) {
+  size_t size = GET_SIZE(HDRP(bp));
+  unsigned int region = GET_REGION(HDRP(bp));
+
+  PUT(HDRP(bp), PACKR(size, region, 0));
+  PUT(FTRP(bp), PACKR(size, region, 0));
+  heap->ad.alloc_bytes -= size;
+  coalesce(heap, bp);
+  if (++heap->scav_tick == SCAV_DONE)
+    heap->scav_tick = 1;
+  if (heap->scav_enabled && heap->scav_tick % SCAV_INTERVAL == 0)
+    scavenge(heap, SCAV_AGE);
+}
+
+/*
+ * realloc_block - Naive implementation of realloc
+ */
+static void *realloc_block(mm_heap_t *heap, void *ptr, size_t size) {
+  size_t oldsize;
+  void *newptr;
+  span_t *s;
+
+  /* If size == 0 then this is just free, and we return NULL. */
+  if (size == 0) {
+    if (ptr != NULL)
+      heap_free(heap, ptr);
+    return 0;
+  }
+
+  /* If oldptr is NULL, then this is just malloc. */
+  if (ptr == NULL) {
+    return heap_malloc(heap, size, REGION_LONG);
+  }
+  if (heap->adaptive)
+    adapt_note(heap, ADAPT_REALLOC, size);
+
+  /* An object in a span stays put as long as it fits */
+  if ((s = pm_get(heap, ptr)) != NULL) {
+    oldsize = ph_usable(s);
+    if (size <= oldsize)
+      return ptr;
+    if ((newptr = heap_malloc(heap, size, REGION_LONG)) == NULL)
+      return 0;
+    wide_copy(newptr, ptr, oldsize);
+    ph_free(heap, s, ptr);
+    return newptr;
+  }
+
+  /* In a realloc heavy phase a block first tries to grow where it is */
+  oldsize = GET_SIZE(HDRP(ptr)) - DSIZE;
+  if (heap->ad.cur.grow && size > oldsize && grow_block(heap, ptr, ADJUST(size)))
+    return ptr;
+
+  /* A large block grows into a block that its pages can be moved to */
+  if (oldsize >= REMAP_MIN && size > oldsize) {
+    newptr = place_congruent(heap, size, GET_REGION(HDRP(ptr)), ptr,
+                             mem_pagesize());
+    if (newptr == NULL)
+      return 0;
+    move_payload(heap, newptr, ptr, oldsize);
+    free_block(heap, ptr);
+    return newptr;
+  }
+
+  /* The new block stays in the region of the old one */
+  newptr = heap_malloc(heap, size, GET_REGION(HDRP(ptr)));
+
+  /* If realloc() fails the original block is left untouched  */
+  if (!newptr) {
+    return 0;
+  }
+
+  /* Copy the old data. */
+  oldsize = GET_SIZE(HDRP(ptr));
+  if (size < oldsize)
+    oldsize = size;
+  wide_copy(newptr, ptr, oldsize);
+
+  /* Free the old block. */
+  free_block(heap, ptr);
+
+  return newptr;
+}
+
+/*
+ * extend_heap - Extend heap with free block and return its block pointer
+ */
+inline static void *extend_heap(mm_heap_t *heap, size_t words,
+                                unsigned int region) {
+  char *bp;
+  size_t size, hpage;
+
+  /* Allocate an even number of words to maintain alignment */
+  size = (words % 2) ? (words + 1) * WSIZE : words * WSIZE;
+  /* On a huge page backed heap, grow up to the next huge page boundary */
+  if ((hpage = mem_region_hugepagesize(heap->mem)) != 0) {
+    size_t brk = (size_t)mem_region_hi(heap->mem) + 1;
+    size = ((brk + size + hpage - 1) & ~(hpage - 1)) - brk;
+  }
+  if ((long)(bp = mem_region_sbrk(heap->mem, size)) == -1)
+    return NULL;
+  /* Initialize the epilogue header and free block footer/header; the
+   * old epilogue goes last, see shared_recover */
+  PUT(HDRP(bp + size), PACK(0, 1));               /* New epilogue header */
+  PUT(bp + size - DSIZE, PACKR(size, region, 0)); /* Free block footer */
+  TAG_FENCE();
+  PUT(HDRP(bp), PACKR(size, region, 0));          /* Free block header */
+  /* Coalesce if the previous block was free */
+  return coalesce(heap, bp);
+}
+
+/*
+ * grow_tail - Extend the heap just enough for the free block at its end
+ *             to hold asize bytes in region, and return that block
+ */
+static void *grow_tail(mm_heap_t *heap, size_t asize, unsigned int region) {
+  char *tail = PREV_BLKP((char *)mem_region_hi(heap->mem) + 1);
+  size_t need = asize;
+
+  if (!GET_ALLOC(HDRP(tail)) && GET_REGION(HDRP(tail)) == region &&
+      GET_SIZE(HDRP(tail)) < asize)
+    need -= GET_SIZE(HDRP(tail));
+  return extend_heap(heap, need / WSIZE, region);
+}
+
+/*
+ * coalesce - Boundary tag coalescing. Return ptr to coalesced block
+ * A neighbour in another lifetime region counts as allocated.
+ */
+inline static void *coalesce(mm_heap_t *heap, void *bp) {
+  unsigned int region = GET_REGION(HDRP(bp));
+  size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp))) ||
+                      GET_REGION(FTRP(PREV_BLKP(bp))) != region;
+  size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp))) ||
+                      GET_REGION(HDRP(NEXT_BLKP(bp))) != region;
+  size_t size = GET_SIZE(HDRP(bp));
+
+  if (prev_alloc && next_alloc) { /* Case 1 */
+    add_free_block(heap, bp);
+  }
+
+  else if (prev_alloc && !next_alloc) { /* Case 2 */
+    size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
+    delete_free_block(heap, NEXT_BLKP(bp));
+    PUT(HDRP(bp), PACKR(size, region, 0));
+    PUT(FTRP(bp), PACKR(size, region, 0));
+    add_free_block(heap, bp);
+  }
+
+  else if (!prev_alloc && next_alloc) { /* Case 3 */
+    size += GET_SIZE(HDRP(PREV_BLKP(bp)));
+    PUT(FTRP(bp), PACKR(size, region, 0));
+    PUT(HDRP(PREV_BLKP(bp)), PACKR(size, region, 0));
+    bp = PREV_BLKP(bp);
+  }
+
+  else { /* Case 4 */
+    size += GET_SIZE(HDRP(PREV_BLKP(bp))) + GET_SIZE(FTRP(NEXT_BLKP(bp)));
+    PUT(HDRP(PREV_BLKP(bp)), PACKR(size, region, 0));
+    PUT(FTRP(NEXT_BLKP(bp)), PACKR(size, region, 0));
+    delete_free_block(heap, NEXT_BLKP(bp));
+    bp = PREV_BLKP(bp);
+  }
+  if (size >= SCAV_MINSIZE)
+    PUT(STAMP(bp), heap->scav_tick);
+  return bp;
+}
+
+/*
+ * place - Place block of asize bytes at start of free block bp
+ *         and split if remainder would be at least minimum block size
+ */
+inline static void place(mm_heap_t *heap, void *bp, size_t asize) {
+  size_t csize = GET_SIZE(HDRP(bp));
+  unsigned int region = GET_REGION(HDRP(bp));
+  if ((csize - asize) >= (2 * DSIZE)) {
+    /* the remainder keeps the idle stamp of the block it was split from */
+    unsigned int stamp = csize >= SCAV_MINSIZE ? GET(STAMP(bp)) : heap->scav_tick;
+    char *rest = (char *)bp + asize;
+    /* the remainder is tagged before bp shrinks, so the headers chain up
+     * at every step, see shared_recover */
+    PUT(HDRP(rest), PACKR(csize - asize, region, 0));
+    PUT(FTRP(rest), PACKR(csize - asize, region, 0));
+    if (csize - asize >= SCAV_MINSIZE)
+      PUT(STAMP(rest), stamp);
+    PUT(rest - DSIZE, PACKR(asize, region, 1));
+    TAG_FENCE();
+    PUT(HDRP(bp), PACKR(asize, region, 1));
+    delete_free_block(heap, bp);
+    heap->ad.alloc_bytes += asize;
+    add_free_block(heap, rest);
+  } else {
+    PUT(HDRP(bp), PACKR(csize, region, 1));
+    PUT(FTRP(bp), PACKR(csize, region, 1));
+    delete_free_block(heap, bp);
+    heap->ad.alloc_bytes += csize;
+  }
+}
+
+/*
+ * place_split - place, except that with SPLIT_SIZED a request smaller than
+ *               the mean is cut from the end of bp, so small and large
+ *               blocks gather at opposite ends of the free space and the
+ *               holes large ones leave stay whole. Return the block.
+ */
+static void *place_split(mm_heap_t *heap, char *bp, size_t asize) {
+  size_t csize = GET_SIZE(HDRP(bp));
+  unsigned int region = GET_REGION(HDRP(bp));
+  char *back;
+
+  if (heap->ad.cur.split != SPLIT_SIZED || asize >= heap->ad.mean ||
+      csize - asize < 2 * DSIZE) {
+    place(heap, bp, asize);
+    return bp;
+  }
+  /* the front keeps its idle stamp and goes to the head of the list, as
+   * the remainder of a low split would */
+  back = bp + csize - asize;
+  PUT(HDRP(back), PACKR(asize, region, 1));
+  PUT(FTRP(back), PACKR(asize, region, 1));
+  delete_free_block(heap, bp);
+  PUT(back - DSIZE, PACKR(csize - asize, region, 0));
+  TAG_FENCE();
+  PUT(HDRP(bp), PACKR(csize - asize, region, 0));
+  add_free_block(heap, bp);
+  heap->ad.alloc_bytes += asize;
+  return back;
+}
+
+/*
+ * grow_block - Grow the allocated block bp to asize bytes where it is, by
+ *              taking in the free block after it, or new heap if bp is
+ *              the last block. Return 0 if it cannot.
+ */
+static int grow_block(mm_heap_t *heap, char *bp, size_t asize) {
+  unsigned int tags = GET(HDRP(bp)) & 0x7;
+  unsigned int region = GET_REGION(HDRP(bp));
+  size_t size = GET_SIZE(HDRP(bp));
+  char *next = NEXT_BLKP(bp);
+
+  if (GET_SIZE(HDRP(next)) == 0 &&
+      extend_heap(heap, (asize - size) / WSIZE, region) == NULL)
+    return 0;
+  if (GET_ALLOC(HDRP(next)) || GET_REGION(HDRP(next)) != region ||
+      size + GET_SIZE(HDRP(next)) < asize)
+    return 0;
+  heap->ad.alloc_bytes -= size;
+  size += GET_SIZE(HDRP(next));
+  delete_free_block(heap, next);
+  if (size - asize >= 2 * DSIZE) {
+    next = bp + asize;
+    PUT(HDRP(next), PACKR(size - asize, region, 0));
+    PUT(FTRP(next), PACKR(size - asize, region, 0));
+    if (size - asize >= SCAV_MINSIZE)
+      PUT(STAMP(next), heap->scav_tick);
+    PUT(next - DSIZE, asize | tags);
+    TAG_FENCE();
+    PUT(HDRP(bp), asize | tags);
+    add_free_block(heap, next);
+  } else {
+    PUT(HDRP(bp), size | tags);
+    PUT(FTRP(bp), size | tags);
+  }
+  heap->ad.alloc_bytes += GET_SIZE(HDRP(bp));
+  return 1;
+}
+
+/*
+ * find_fit - Find a fit for a block with asize bytes
+ * this function uses stategy which find a good block
+ * maybe not the best: the smallest fit, unless one wasting less than the
+ * slack of the fit policy comes first
+ */
+inline static void *find_fit(mm_heap_t *heap, size_t asize,
+                                   unsigned int region) {
+  void *bp = NULL;
+  size_t tmp = 1 << 31;
+  void *record = NULL;
+  size_t slack = heap->ad.cur.fit == FIT_FIRST ? (size_t)1 << 31 : FIT_SLACK;
+  for (bp = FR_LIST(heap, region); bp != NULL && GET(NEXT_FRBP(bp)) != 0;
+       bp = bp + (int)GET(NEXT_FRBP(bp))) {
+    if (GET_SIZE(HDRP(bp)) >= asize && GET_SIZE(HDRP(bp)) < tmp) {
+      record = bp;
+      tmp = GET_SIZE(HDRP(bp));
+      if (tmp - asize < slack)
+        return record;
+    }
+  }
+  if (bp != NULL && GET_SIZE(HDRP(bp)) >= asize && GET_SIZE(HDRP(bp)) < tmp) {
+    return bp;
+  }
+  return record;
+}
+/*
+ * place_congruent - Allocate a block with at least size bytes of payload
+ *                   in the given region, whose payload starts at the same
+ *                   offset as like within a unit of align bytes, a power
+ *                   of two. The free space in front of it stays a free
+ *                   block.
+ */
+static void *place_congruent(mm_heap_t *heap, size_t size,
+                             unsigned int region, char *like, size_t align) {
+  size_t asize = ADJUST(size);
+  size_t need = asize + align + 2 * DSIZE;
+  size_t fsize, pad;
+  unsigned int stamp;
+  char *fbp, *bp;
+
+  /* the first fit may happen to be congruent already */
+  if ((fbp = find_fit(heap, asize, region)) != NULL &&
+      (((size_t)like - (size_t)fbp) & (align - 1)) == 0) {
+    place(heap, fbp, asize);
+    return fbp;
+  }
+  if ((fbp = find_fit(heap, need, region)) == NULL &&
+      (fbp = extend_heap(heap, need / WSIZE, region)) == NULL)
+    return NULL;
+  /* the space in front must be empty or hold a minimum free block */
+  pad = ((size_t)like - (size_t)fbp) & (align - 1);
+  if (pad && pad < 2 * DSIZE)
+    pad += align;
+  if (pad) {
+    fsize = GET_SIZE(HDRP(fbp));
+    stamp = fsize >= SCAV_MINSIZE ? GET(STAMP(fbp)) : heap->scav_tick;
+    bp = fbp + pad;
+    PUT(HDRP(bp), PACKR(fsize - pad, region, 0));
+    PUT(FTRP(bp), PACKR(fsize - pad, region, 0));
+    if (fsize - pad >= SCAV_MINSIZE)
+      PUT(STAMP(bp), stamp);
+    PUT(bp - DSIZE, PACKR(pad, region, 0));
+    TAG_FENCE();
+    PUT(HDRP(fbp), PACKR(pad, region, 0));
+    if (pad >= SCAV_MINSIZE)
+      PUT(STAMP(fbp), stamp);
+    add_free_block(heap, bp);
+    fbp = bp;
+  }
+  place(heap, fbp, asize);
+  return fbp;
+}
+
+/*
+ * move_payload - Copy n bytes from src to dst. If both are at the same
+ *                offset within a page, the whole pages between them are
+ *                remapped and only the partial pages at the ends copied.
+ */
+static void move_payload(mm_heap_t *heap, char *dst, char *src, size_t n) {
+  size_t page = mem_pagesize();
+  size_t head = MIN((page - (size_t)src % page) % page, n);
+  size_t body = (n - head) & ~(page - 1);
+
+  wide_copy(dst, src, head);
+  if (body && mem_region_remap(heap->mem, dst + head, src + head, body) < 0)
+    wide_copy(dst + head, src + head, body);
+  wide_copy(dst + head + body, src + head + body, n - head - body);
+}
+
+/*
+ * The wide copy engine
+ */
+
+/*
+ * copy_words - Copy n bytes, fewer than COPY_WIDE_MIN, in 8-byte moves.
+ *              The last move may overlap the one before it.
+ */
+static inline void copy_words(char *dst, const char *src, size_t n) {
+  unsigned long w;
+  size_t i;
+
+  if (n < 8) {
+    for (i = 0; i < n; i++)
+      dst[i] = src[i];
+    return;
+  }
+  for (i = 0; i + 8 < n; i += 8) {
+    __builtin_memcpy(&w, src + i, 8);
+    __builtin_memcpy(dst + i, &w, 8);
+  }
+  __builtin_memcpy(&w, src + n - 8, 8);
+  __builtin_memcpy(dst + n - 8, &w, 8);
+}
+
+#if defined(__x86_64__)
+/*
+ * copy_sse2 - Copy n bytes, at least 16, in 16-byte moves. All but the
+ *             first and last store go to aligned addresses.
+ */
+static void copy_sse2(char *dst, const char *src, size_t n) {
+  size_t i = (16 - (size_t)dst % 16) % 16;
+
+  _mm_storeu_si128((__m128i *)dst, _mm_loadu_si128((const __m128i *)src));
+  for (; i + 16 < n; i += 16)
+    _mm_storeu_si128((__m128i *)(dst + i),
+                     _mm_loadu_si128((const __m128i *)(src + i)));
+  _mm_storeu_si128((__m128i *)(dst + n - 16),
+                   _mm_loadu_si128((const __m128i *)(src + n - 16)));
+}
+
+/*
+ * copy_sse2_stream - Copy n bytes with non-temporal 16-byte stores
+ */
+static void copy_sse2_stream(char *dst, const char *src, size_t n) {
+  size_t head = (16 - (size_t)dst % 16) % 16, i;
+
+  copy_sse2(dst, src, 16);
+  for (i = head; i + 16 <= n; i += 16)
+    _mm_stream_si128((__m128i *)(dst + i),
+                     _mm_loadu_si128((const __m128i *)(src + i)));
+  _mm_sfence();
+  if (i < n)
+    copy_sse2(dst + n - 16, src + n - 16, 16);
+}
+
+/*
+ * copy_avx2 - Copy n bytes, at least 32, in 32-byte moves, four at a
+ *             time. All but the first and last stores are aligned.
+ */
+__attribute__((target("avx2"))) static void copy_avx2(char *dst,
+                                                      const char *src,
+                                                      size_t n) {
+  size_t i = (32 - (size_t)dst % 32) % 32;
+  __m256i a, b, c, d;
+
+  _mm256_storeu_si256((__m256i *)dst,
+                      _mm256_loadu_si256((const __m256i *)src));
+  for (; i + 128 <= n; i += 128) {
+    a = _mm256_loadu_si256((const __m256i *)(src + i));
+    b = _mm256_loadu_si256((const __m256i *)(src + i + 32));
+    c = _mm256_loadu_si256((const __m256i *)(src + i + 64));
+    d = _mm256_loadu_si256((const __m256i *)(src + i + 96));
+    _mm256_storeu_si256((__m256i *)(dst + i), a);
+    _mm256_storeu_si256((__m256i *)(dst + i + 32), b);
+    _mm256_storeu_si256((__m256i *)(dst + i + 64), c);
+    _mm256_storeu_si256((__m256i *)(dst + i + 96), d);
+  }
+  for (; i + 32 < n; i += 32)
+    _mm256_storeu_si256((__m256i *)(dst + i),
+                        _mm256_loadu_si256((const __m256i *)(src + i)));
+  _mm256_storeu_si256((__m256i *)(dst + n - 32),
+                      _mm256_loadu_si256((const __m256i *)(src + n - 32)));
+}
+
+/*
+ * copy_avx2_stream - Copy n bytes with non-temporal 32-byte stores to an
+ *                    aligned dst, four at a time
+ */
+__attribute__((target("avx2"))) static void
+copy_avx2_stream(char *dst, const char *src, size_t n) {
+  size_t head = (32 - (size_t)dst % 32) % 32, i;
+  __m256i a, b, c, d;
+
+  copy_avx2(dst, src, 32);
+  for (i = head; i + 128 <= n; i += 128) {
+    a = _mm256_loadu_si256((const __m256i *)(src + i));
+    b = _mm256_loadu_si256((const __m256i *)(src + i + 32));
+    c = _mm256_loadu_si256((const __m256i *)(src + i + 64));
+    d = _mm256_loadu_si256((const __m256i *)(src + i + 96));
+    _mm256_stream_si256((__m256i *)(dst + i), a);
+    _mm256_stream_si256((__m256i *)(dst + i + 32), b);
+    _mm256_stream_si256((__m256i *)(dst + i + 64), c);
+    _mm256_stream_si256((__m256i *)(dst + i + 96), d);
+  }
+  _mm_sfence();
+  if (i < n)
+    copy_avx2(dst + n - MAX(n - i, 32), src + n - MAX(n - i, 32),
+              MAX(n - i, 32));
+}
+
+/*
+ * copy_avx512 - Copy n bytes, at least 64, in 64-byte moves, four at a
+ *               time. All but the first and last stores are aligned.
+ */
+__attribute__((target("avx512f"))) static void copy_avx512(char *dst,
+                                                          const char *src,
+                                                          size_t n) {
+  size_t i = (64 - (size_t)dst % 64) % 64;
+  __m512i a, b, c, d;
+
+  _mm512_storeu_si512(dst, _mm512_loadu_si512(src));
+  for (; i + 256 <= n; i += 256) {
+    a = _mm512_loadu_si512(src + i);
+    b = _mm512_loadu_si512(src + i + 64);
+    c = _mm512_loadu_si512(src + i + 128);
+    d = _mm512_loadu_si512(src + i + 192);
+    _mm512_storeu_si512(dst + i, a);
+    _mm512_storeu_si512(dst + i + 64, b);
+    _mm512_storeu_si512(dst + i + 128, c);
+    _mm512_storeu_si512(dst + i + 192, d);
+  }
+  for (; i + 64 < n; i += 64)
+    _mm512_storeu_si512(dst + i, _mm512_loadu_si512(src + i));
+  _mm512_storeu_si512(dst + n - 64, _mm512_loadu_si512(src + n - 64));
+}
+
+/*
+ * copy_avx512_stream - Copy n bytes with non-temporal 64-byte stores to
+ *                      an aligned dst, four at a time
+ */
+__attribute__((target("avx512f"))) static void
+copy_avx512_stream(char *dst, const char *src, size_t n) {
+  size_t head = (64 - (size_t)dst % 64) % 64, i;
+  __m512i a, b, c, d;
+
+  copy_avx512(dst, src, 64);
+  for (i = head; i + 256 <= n; i += 256) {
+    a = _mm512_loadu_si512(src + i);
+    b = _mm512_loadu_si512(src + i + 64);
+    c = _mm512_loadu_si512(src + i + 128);
+    d = _mm512_loadu_si512(src + i + 192);
+    _mm512_stream_si512((__m512i *)(dst + i), a);
+    _mm512_stream_si512((__m512i *)(dst + i + 64), b);
+    _mm512_stream_si512((__m512i *)(dst + i + 128), c);
+    _mm512_stream_si512((__m512i *)(dst + i + 192), d);
+  }
+  _mm_sfence();
+  if (i < n)
+    copy_avx512(dst + n - MAX(n - i, 64), src + n - MAX(n - i, 64),
+                MAX(n - i, 64));
+}
+#endif /* def __x86_64__ */
+
+/*
+ * copy_memcpy - The libc copy, where there are no vector copies
+ */
+static void copy_memcpy(char *dst, const char *src, size_t n) {
+  memcpy(dst, src, n);
+}
+
+/*
+ * copy_setup - Pick the copy routines for the CPU we run on
+ */
+static void copy_setup(void) {
+  long l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+
+  copy_stream_min = l2 > 0 ? (size_t)l2 : COPY_STREAM_MIN;
+  copy_mid = copy_stream = copy_memcpy;
+#if defined(__x86_64__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    copy_mid = copy_avx512;
+    copy_stream = copy_avx512_stream;
+  } else if (__builtin_cpu_supports("avx2")) {
+    copy_mid = copy_avx2;
+    copy_stream = copy_avx2_stream;
+  } else {
+    copy_mid = copy_sse2;
+    copy_stream = copy_sse2_stream;
+  }
+#endif
+}
+
+/*
+ * wide_copy - Copy n bytes from src to dst, which do not overlap, by the
+ *             method that suits n
+ */
+static void wide_copy(char *dst, const char *src, size_t n) {
+  if (!wide_enabled) {
+    memcpy(dst, src, n);
+    return;
+  }
+  if (n < COPY_WIDE_MIN) {
+    copy_words(dst, src, n);
+    return;
+  }
+  if (copy_mid == NULL)
+    copy_setup();
+  if (n >= copy_stream_min)
+    copy_stream(dst, src, n);
+  else
+    copy_mid(dst, src, n);
+}
+
+/* add a freed block to the free block list of its region
+ */
+inline static void add_free_block(mm_heap_t *heap, void *bp) {
+  char **listp = &FR_LIST(heap, GET_REGION(HDRP(bp)));
+  if (*listp == NULL) {
+    *listp = bp;
+    PUT(NEXT_FRBP(bp), 0);
+    PUT(PREV_FRBP(bp), 0);
+  } else {
+    PUT(PREV_FRBP(bp), 0);
+    PUT(NEXT_FRBP(bp), ADDR_SUB(*listp, bp));
+    PUT(PREV_FRBP(*listp), ADDR_SUB(bp, *listp));
+    *listp = bp;
+  }
+}
+/* delete a freed block to the free block list of its region
+ */
+inline static void delete_free_block(mm_heap_t *heap, void *bp) {
+  char **listp = &FR_LIST(heap, GET_REGION(HDRP(bp)));
+  if (bp == *listp) {
+    if (GET(NEXT_FRBP(bp))) {
+      *listp = bp + (int)(GET(NEXT_FRBP(bp)));
+      PUT(PREV_FRBP(*listp), 0);
+    } else {
+      *listp = 0;
+    }
+  } else {
+    if (GET(NEXT_FRBP(bp))) {
+      char *tmp1 = (int)GET(PREV_FRBP(bp)) + bp;
+      char *tmp2 = (int)GET(NEXT_FRBP(bp)) + bp;
+      PUT(NEXT_FRBP(tmp1), ADDR_SUB(tmp2, tmp1));
+      PUT(PREV_FRBP(tmp2), ADDR_SUB(tmp1, tmp2));
+    } else {
+      char *tmp = (int)GET(PREV_FRBP(bp)) + bp;
+      PUT(NEXT_FRBP(tmp), 0);
+    }
+  }
+}
+
+/*
+ * scavenge - Release the whole pages inside every free block that has
+ *            been idle for at least age frees. The pages are faulted back
+ *            in as zeros when the block is reused, so nothing else has to
+ *            know about it. Return the number of bytes released.
+ */
+static size_t scavenge(mm_heap_t *heap, unsigned int age) {
+  size_t released = 0;
+  int i;
+  for (i = 0; i < NREGIONS; i++) {
+    char *bp = heap->fr_listp[i];
+    while (bp != NULL) {
+      size_t size = GET_SIZE(HDRP(bp));
+      if (size >= SCAV_MINSIZE && GET(STAMP(bp)) != SCAV_DONE &&
+          heap->scav_tick - GET(STAMP(bp)) >= age) {
+        /* keep the links, the stamp and the footer mapped */
+        released += mem_region_release(heap->mem, STAMP(bp) + WSIZE,
+                                       size - 5 * WSIZE);
+        PUT(STAMP(bp), SCAV_DONE);
+      }
+      bp = GET(NEXT_FRBP(bp)) ? bp + (int)GET(NEXT_FRBP(bp)) : NULL;
+    }
+  }
+  return released;
+}
+
+/**************************************
+ * Adaptive policy
+ *
+ *************************************/
+
+/*
+ * log2_q8 - log2 of x > 0 in 1/256ths, linear between powers of two
+ */
+static unsigned int log2_q8(size_t x) {
+  unsigned int ip = 63 - __builtin_clzl(x);
+  return (ip << 8) + (unsigned int)(((x << 8) >> ip) & 0xff);
+}
+
+/*
+ * adapt_choose - The policies for a window with the given signals, all
+ *                in 1/256ths: the entropy of the sizes in bits, the share
+ *                of small sizes among them, the shares of reallocs and of
+ *                turns among the requests and the free share of the heap.
+ *                The thresholds to leave a policy lie past those to take
+ *                it, so a signal wavering around one does not make the
+ *                policies flap.
+ */
+static policy_t adapt_choose(mm_heap_t *heap, unsigned int entropy,
+                             unsigned int small, unsigned int reallocs,
+                             unsigned int turns, unsigned int frag) {
+  policy_t cur = heap->ad.cur, p;
+
+  /* in a tidy heap under churn the first fit is about as good */
+  p.fit = frag < (cur.fit == FIT_FIRST ? 24 : 16) &&
+                  turns > (cur.fit == FIT_FIRST ? 96 : 128)
+              ? FIT_FIRST
+              : FIT_GOOD;
+  /* a few sizes: keep the small ones out of the way of the large */
+  p.split = entropy < (cur.split == SPLIT_SIZED ? 3 << 8 : 2 << 8) &&
+                    small > (cur.split == SPLIT_SIZED ? 16 : 32)
+                ? SPLIT_SIZED
+                : SPLIT_LOW;
+  /* churn of a few sizes: freed blocks are taken again as they are */
+  p.quick = turns > (cur.quick ? 96 : 128) &&
+            entropy < (cur.quick ? 4 << 8 : 3 << 8) && frag < 64;
+  p.grow = reallocs > (cur.grow ? 16 : 32);
+  return p;
+}
+
+/*
+ * adapt_window - Look at the signals of the window just ended, switch
+ *                policies if the same new ones were picked ADAPT_HOLD
+ *                times in a row, and start the next window
+ */
+static void adapt_window(mm_heap_t *heap) {
+  adapt_t *ad = &heap->ad;
+  size_t heapsize = (char *)mem_region_hi(heap->mem) + 1 - heap->heap_listp;
+  size_t plogp = 0;
+  unsigned int entropy = 0, frag;
+  policy_t p;
+  int i;
+
+  /* Shannon entropy of the size buckets, log2(n) - sum(c log2(c)) / n */
+  if (ad->sized) {
+    for (i = 0; i < ADAPT_BUCKETS; i++)
+      if (ad->hist[i])
+        plogp += (size_t)ad->hist[i] * log2_q8(ad->hist[i]);
+    entropy = log2_q8(ad->sized) - plogp / ad->sized;
+    ad->mean = ad->size_sum / ad->sized;
+  }
+  /* blocks on the quick lists are still counted as allocated */
+  frag = ((heapsize - ad->alloc_bytes + heap->quick_bytes) << 8) / heapsize;
+  p = adapt_choose(heap, entropy, (ad->small << 8) / MAX(ad->sized, 1),
+                   (ad->reallocs << 8) / ad->ops, (ad->turns << 8) / ad->ops,
+                   frag);
+  if (memcmp(&p, &ad->next, sizeof(p)) == 0) {
+    ad->streak++;
+  } else {
+    ad->next = p;
+    ad->streak = 1;
+  }
+  if (ad->streak >= ADAPT_HOLD && memcmp(&p, &ad->cur, sizeof(p)))
+    adapt_apply(heap, p);
+
+  ad->ops = ad->sized = ad->small = ad->reallocs = ad->turns = 0;
+  ad->size_sum = 0;
+  memset(ad->hist, 0, sizeof(ad->hist));
+}
+
+/*
+ * adapt_note - Count a request of the given kind, for size bytes if it
+ *              is a malloc or realloc, into the signals of the window
+ */
+static void adapt_note(mm_heap_t *heap, int kind, size_t size) {
+  adapt_t *ad = &heap->ad;
+  int is_free = kind == ADAPT_FREE;
+
+  if (is_free != ad->last_free)
+    ad->turns++;
+  ad->last_free = is_free;
+  if (kind == ADAPT_REALLOC)
+    ad->reallocs++;
+  if (!is_free) {
+    size = ADJUST(size);
+    ad->sized++;
+    ad->size_sum += size;
+    if (size < ad->size_sum / ad->sized / 2)
+      ad->small++;
+    /* Fibonacci hashing spreads the sizes over the buckets */
+    ad->hist[((size >> 3) * 2654435769u & 0xffffffffu) >> 26]++;
+  }
+  if (++ad->ops == ADAPT_WINDOW)
+    adapt_window(heap);
+}
+
+/*
+ * adapt_apply - Put the policies p in force
+ */
+static void adapt_apply(mm_heap_t *heap, policy_t p) {
+  if (!p.quick)
+    quick_flush(heap);
+  heap->ad.cur = p;
+}
+
+/*
+ * quick_push - Keep the freed block bp, still marked allocated, on the
+ *              quick list of its size. Return 0 if it is not a small
+ *              block of the long lived region or the lists are full.
+ */
+static int quick_push(mm_heap_t *heap, char *bp) {
+  size_t size = GET_SIZE(HDRP(bp));
+
+  if (size > QL_MAX || (GET(HDRP(bp)) & (REGION_SHORT | MOVABLE)) ||
+      heap->line_align || heap->quick_bytes + size > QL_BYTES)
+    return 0;
+  *(char **)bp = heap->quick[size / DSIZE];
+  heap->quick[size / DSIZE] = bp;
+  heap->quick_bytes += size;
+  return 1;
+}
+
+/*
+ * quick_flush - Free and coalesce every block on the quick lists
+ */
+static void quick_flush(mm_heap_t *heap) {
+  char *bp;
+  int i;
+
+  for (i = 0; i < QL_CLASSES && heap->quick_bytes; i++)
+    while ((bp = heap->quick[i]) != NULL) {
+      heap->quick[i] = *(char **)bp;
+      heap->quick_bytes -= GET_SIZE(HDRP(bp));
+      free_block(heap, bp);
+    }
+}
+
+/*
+ * reserve_pop - A block of asize bytes set aside by mm_reserve, NULL if
+ *               there is none left
+ */
+static void *reserve_pop(mm_heap_t *heap, size_t asize) {
+  reserve_t *rs;
+  char *bp;
+
+  for (rs = heap->reserve; rs < heap->reserve + RESERVE_CLASSES; rs++)
+    if (rs->asize == asize) {
+      bp = rs->list;
+      if ((rs->list = *(char **)bp) == NULL)
+        rs->asize = 0;
+      heap->reserve_bytes -= GET_SIZE(HDRP(bp));
+      return bp;
+    }
+  return NULL;
+}
+
+/*
+ * reserve_flush - Free and coalesce every block set aside by mm_reserve
+ */
+static void reserve_flush(mm_heap_t *heap) {
+  reserve_t *rs;
+  char *bp;
+
+  for (rs = heap->reserve; rs < heap->reserve + RESERVE_CLASSES; rs++) {
+    while ((bp = rs->list) != NULL) {
+      rs->list = *(char **)bp;
+      heap->reserve_bytes -= GET_SIZE(HDRP(bp));
+      free_block(heap, bp);
+    }
+    rs->asize = 0;
+  }
+}
+
+/**************************************
+ * Soft limit
+ *
+ *************************************/
+
+/*
+ * pressure - Place a block of asize bytes that does not fit in the heap,
+ *            which cannot grow by a chunk without passing the soft limit.
+ *            Try to make room in the heap first, then call the reclaim
+ *            callbacks, and grow only when neither made the block fit.
+ */
+static void *pressure(mm_heap_t *heap, size_t asize, unsigned int region) {
+  size_t need, freed;
+  char *bp;
+  int i;
+
+  soft.st.pressure++;
+  /* stage 1: coalesce the quick and reserve lists, release free pages */
+  soft.st.trims++;
+  quick_flush(heap);
+  reserve_flush(heap);
+  soft.st.trim_bytes += scavenge(heap, 0);
+  if ((bp = find_fit(heap, asize, region)) != NULL) {
+    soft.st.trim_fits++;
+    return place_split(heap, bp, asize);
+  }
+
+  /* stage 2: let the application drop what it can spare */
+  if (!soft.busy) {
+    soft.busy = 1;
+    for (i = 0; i < soft.nreclaim; i++) {
+      need = mem_region_size(heap->mem) + asize > soft.limit
+                 ? mem_region_size(heap->mem) + asize - soft.limit
+                 : asize;
+      soft.st.reclaims++;
+      freed = soft.reclaim[i](need);
+      soft.st.reclaim_bytes += freed;
+      if (freed && (bp = find_fit(heap, asize, region)) != NULL) {
+        soft.busy = 0;
+        soft.st.reclaim_fits++;
+        return place_split(heap, bp, asize);
+      }
+    }
+    soft.busy = 0;
+  }
+
+  /* stage 3: grow by what the free block at the end lacks, no chunk */
+  if ((bp = grow_tail(heap, asize, region)) == NULL) {
+    soft.st.fails++;
+    return NULL;
+  }
+  if (mem_region_size(heap->mem) > soft.limit)
+    soft.st.grows++;
+  return place_split(heap, bp, asize);
+}
+
+/**************************************
+ * Shared heaps
+ *
+ *************************************/
+
+/*
+ * shared_recover - Rebuild the free lists of a shared heap from the tags
+ *                  of its blocks, after a process died holding the lock,
+ *                  maybe halfway through changing them. A split tags the
+ *                  later block before the header of the earlier one shrinks
+ *                  to it, and the heap grows by a new epilogue before the
+ *                  old one is overwritten, so the headers chain up at any
+ *                  point the process may die at and are taken to be right;
+ *                  footers are made to match them, and free blocks left
+ *                  next to each other are merged. Space the heap grew by
+ *                  past its last block becomes a free block.
+ */
+static void shared_recover(mm_heap_t *heap) {
+  char *bp, *next, *end = (char *)mem_region_hi(heap->mem) + 1;
+  unsigned int region;
+  size_t size;
+
+  for (bp = NEXT_BLKP(heap->heap_listp); GET_SIZE(HDRP(bp));
+       bp = NEXT_BLKP(bp))
+    ;
+  if (bp < end) {
+    PUT(HDRP(end), PACK(0, 1));
+    PUT(end - DSIZE, PACKR(end - bp, REGION_LONG, 0));
+    TAG_FENCE();
+    PUT(HDRP(bp), PACKR(end - bp, REGION_LONG, 0));
+  }
+  memset(heap->fr_listp, 0, sizeof(heap->fr_listp));
+  for (bp = NEXT_BLKP(heap->heap_listp); GET_SIZE(HDRP(bp)); bp = next) {
+    PUT(FTRP(bp), GET(HDRP(bp)));
+    next = NEXT_BLKP(bp);
+    if (GET_ALLOC(HDRP(bp)))
+      continue;
+    region = GET_REGION(HDRP(bp));
+    while (GET_SIZE(HDRP(next)) && !GET_ALLOC(HDRP(next)) &&
+           GET_REGION(HDRP(next)) == region) {
+      size = GET_SIZE(HDRP(bp)) + GET_SIZE(HDRP(next));
+      PUT(HDRP(bp), PACKR(size, region, 0));
+      PUT(FTRP(bp), PACKR(size, region, 0));
+      next = NEXT_BLKP(bp);
+    }
+    if (GET_SIZE(HDRP(bp)) >= SCAV_MINSIZE)
+      PUT(STAMP(bp), heap->scav_tick);
+    add_free_block(heap, bp);
+  }
+}
+
+/*
+ * shared_make - Make a shared heap in the empty region of view heap,
+ *               which the caller has locked; NULL on error
+ */
+static mm_shared_t *shared_make(mm_heap_t *heap) {
+  pthread_mutexattr_t attr;
+  mm_shared_t *sh;
+  int err;
+
+  if ((sh = mem_region_sbrk(heap->mem, ALIGN(sizeof(mm_shared_t)))) ==
+      (void *)-1)
+    return NULL;
+  memset(sh, 0, sizeof(mm_shared_t));
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+  pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+  err = pthread_mutex_init(&sh->lock, &attr);
+  pthread_mutexattr_destroy(&attr);
+  if (err != 0 || heap_init(heap) < 0)
+    return NULL;
+  heap->shared = sh;
+  pthread_mutex_lock(&sh->lock);
+  shared_unlock(heap);
+  /* views that see the magic see the heap behind it */
+  __atomic_store_n(&sh->magic, SHARED_MAGIC, __ATOMIC_RELEASE);
+  return sh;
+}
+
+/*
+ * shared_lock - Lock a shared heap and take its state into the view
+ */
+static void shared_lock(mm_heap_t *heap) {
+  mm_shared_t *sh = heap->shared;
+  int dead = pthread_mutex_lock(&sh->lock) == EOWNERDEAD;
+  int i;
+
+  heap->heap_listp = heap->base + sh->listp;
+  for (i = 0; i < NREGIONS; i++)
+    heap->fr_listp[i] = sh->fr_list[i] ? heap->base + sh->fr_list[i] : NULL;
+  heap->scav_tick = sh->scav_tick;
+  heap->root = sh->root;
+  if (dead) {
+    shared_recover(heap);
+    pthread_mutex_consistent(&sh->lock);
+  }
+}
+
+/*
+ * shared_unlock - Put the state of the view back as offsets and unlock
+ */
+static void shared_unlock(mm_heap_t *heap) {
+  mm_shared_t *sh = heap->shared;
+  int i;
+
+  sh->listp = ADDR_SUB(heap->heap_listp, heap->base);
+  for (i = 0; i < NREGIONS; i++)
+    sh->fr_list[i] =
+        heap->fr_listp[i] ? ADDR_SUB(heap->fr_listp[i], heap->base) : 0;
+  sh->scav_tick = heap->scav_tick;
+  sh->root = heap->root;
+  pthread_mutex_unlock(&sh->lock);
+}
+
+/**************************************
+ * Page heap for mid-sized requests
+ *
+ *************************************/
+
+/* The radix tree has PM_ROOT leaves of PM_LEAF spans, enough for the
+ * 32-bit offsets the heap works with */
+#define PM_LEAF_BITS 9
+#define PM_LEAF (1 << PM_LEAF_BITS)
+#define PM_ROOT (1 << (32 - PH_SHIFT - PM_LEAF_BITS))
+
+/* Address of page number pg and page number of address p */
+#define PH_ADDR(heap, pg)                                                      \
+  ((char *)mem_region_lo((heap)->mem) + ((size_t)(pg) << PH_SHIFT))
+#define PH_PAGENO(heap, p)                                                     \
+  ((size_t)((char *)(p) - (char *)mem_region_lo((heap)->mem)) >> PH_SHIFT)
+
+/*
+ * heap_malloc - Allocate from the page heap if it is on and size is in its
+ *               range, else from the blocks of the given region, aligned
+ *               to a line if asked for. Spans are already aligned.
+ */
+static void *heap_malloc(mm_heap_t *heap, size_t size, unsigned int region) {
+  char *bp;
+  if (heap->adaptive)
+    adapt_note(heap, ADAPT_MALLOC, size);
+  /* a block set aside by mm_reserve, which is not line-aligned */
+  if (heap->reserve_bytes && region == REGION_LONG && size &&
+      !heap->line_align && (bp = reserve_pop(heap, ADJUST(size))) != NULL)
+    return bp;
+  /* a block of the exact size from the quick lists */
+  if (heap->quick_bytes && region == REGION_LONG && size &&
+      ADJUST(size) <= QL_MAX &&
+      (bp = heap->quick[ADJUST(size) / DSIZE]) != NULL) {
+    heap->quick[ADJUST(size) / DSIZE] = *(char **)bp;
+    heap->quick_bytes -= ADJUST(size);
+    return bp;
+  }
+  if (heap->ph_enabled && region == REGION_LONG && size >= PH_MINSIZE &&
+      size <= PH_MAXSIZE)
+    return ph_malloc(heap, size);
+  /* whole lines with the tags, so the block after is aligned as well */
+  if (heap->line_align && size >= LINE_SIZE)
+    return place_congruent(heap, LINE_ALIGN(size + DSIZE) - DSIZE, region,
+                           mem_region_lo(heap->mem), LINE_SIZE);
+  return malloc_region(heap, size, region);
+}
+
+/*
+ * heap_free - Free an object of a span or a block
+ */
+static void heap_free(mm_heap_t *heap, void *bp) {
+  span_t *s;
+  if (heap->adaptive)
+    adapt_note(heap, ADAPT_FREE, 0);
+  if ((s = pm_get(heap, bp)) != NULL)
+    ph_free(heap, s, bp);
+  else if (!heap->ad.cur.quick || !quick_push(heap, bp))
+    free_block(heap, bp);
+}
+
+/*
+ * pm_page - The span page number pg belongs to, NULL if none
+ */
+static span_t *pm_page(mm_heap_t *heap, size_t pg) {
+  span_t **leaf;
+  if (heap->pagemap == NULL || pg >= (size_t)PM_ROOT * PM_LEAF)
+    return NULL;
+  leaf = heap->pagemap[pg >> PM_LEAF_BITS];
+  return leaf ? leaf[pg & (PM_LEAF - 1)] : NULL;
+}
+
+/*
+ * pm_get - The span the object at bp belongs to, NULL if bp is a block
+ */
+static span_t *pm_get(mm_heap_t *heap, void *bp) {
+  if (heap->pagemap == NULL || (char *)bp < (char *)mem_region_lo(heap->mem))
+    return NULL;
+  return pm_page(heap, PH_PAGENO(heap, bp));
+}
+
+/*
+ * pm_set - Map npages pages from page start to s, making leaves as
+ *          needed. Return -1 on error.
+ */
+static int pm_set(mm_heap_t *heap, size_t start, size_t npages, span_t *s) {
+  span_t **leaf;
+  size_t pg;
+  for (pg = start; pg < start + npages; pg++) {
+    if ((leaf = heap->pagemap[pg >> PM_LEAF_BITS]) == NULL) {
+      if ((leaf = malloc_region(heap, PM_LEAF * sizeof(span_t *),
+                                REGION_LONG)) == NULL)
+        return -1;
+      memset(leaf, 0, PM_LEAF * sizeof(span_t *));
+      heap->pagemap[pg >> PM_LEAF_BITS] = leaf;
+    }
+    leaf[pg & (PM_LEAF - 1)] = s;
+  }
+  return 0;
+}
+
+/*
+ * span_push - Put s at the front of list
+ */
+static void span_push(span_t **list, span_t *s) {
+  s->prev = NULL;
+  s->next = *list;
+  if (*list)
+    (*list)->prev = s;
+  *list = s;
+}
+
+/*
+ * span_unlink - Take s off list
+ */
+static void span_unlink(span_t **list, span_t *s) {
+  if (s->prev)
+    s->prev->next = s->next;
+  else
+    *list = s->next;
+  if (s->next)
+    s->next->prev = s->prev;
+}
+
+/*
+ * span_new - Make the metadata of a span of npages pages from page start
+ */
+static span_t *span_new(mm_heap_t *heap, size_t start, size_t npages) {
+  span_t *s = malloc_region(heap, sizeof(span_t), REGION_LONG);
+  if (s == NULL)
+    return NULL;
+  s->start = start;
+  s->npages = npages;
+  s->cls = PH_FREE;
+  s->nfree = 0;
+  s->objs = NULL;
+  return s;
+}
+
+/*
+ * ph_class - The class of a request of PH_MINSIZE to PH_SLICE_MAX bytes
+ */
+static unsigned int ph_class(size_t size) {
+  unsigned int lg;
+  if (size <= PH_MINSIZE)
+    return 0;
+  lg = 31 - __builtin_clz(size - 1);
+  return (lg - 10) * 4 + ((size - 1 - (1u << lg)) >> (lg - 2)) + 1;
+}
+
+/*
+ * ph_size - Object size of class cls
+ */
+static size_t ph_size(unsigned int cls) {
+  unsigned int lg = 10 + cls / 4;
+  return (1u << lg) + (cls % 4) * (1u << (lg - 2));
+}
+
+/*
+ * ph_usable - Bytes an object of span s can hold
+ */
+static size_t ph_usable(span_t *s) {
+  return s->cls == PH_RUN ? (size_t)s->npages << PH_SHIFT : ph_size(s->cls);
+}
+
+/*
+ * ph_grow - Take a chunk of at least npages pages from the heap as one
+ *           free span. Chunks are page-aligned blocks, so the footer and
+ *           header between two of them always leave a page out and spans
+ *           never coalesce across chunks.
+ */
+static span_t *ph_grow(mm_heap_t *heap, size_t npages) {
+  span_t *s;
+  char *bp;
+  npages = MAX(npages, PH_CHUNK_PAGES);
+  if (heap->pagemap == NULL) {
+    if ((heap->pagemap = malloc_region(heap, PM_ROOT * sizeof(span_t **),
+                                       REGION_LONG)) == NULL)
+      return NULL;
+    memset(heap->pagemap, 0, PM_ROOT * sizeof(span_t **));
+  }
+  bp = place_congruent(heap, npages << PH_SHIFT, REGION_LONG,
+                       mem_region_lo(heap->mem), PH_PAGE);
+  if (bp == NULL)
+    return NULL;
+  if ((s = span_new(heap, PH_PAGENO(heap, bp), npages)) == NULL ||
+      pm_set(heap, s->start, npages, s) < 0) {
+    if (s != NULL) {
+      pm_set(heap, s->start, npages, NULL);
+      free_block(heap, s);
+    }
+    free_block(heap, bp);
+    return NULL;
+  }
+  return s;
+}
+
+/*
+ * ph_alloc_pages - Take a span of npages pages, first fit over the free
+ *                  spans by length, splitting off the rest
+ */
+static span_t *ph_alloc_pages(mm_heap_t *heap, size_t npages) {
+  span_t *s, *rest;
+  unsigned int bin;
+  for (bin = PH_BIN(npages); bin < PH_BINS; bin++)
+    for (s = heap->ph_free[bin]; s; s = s->next)
+      if (s->npages >= npages) {
+        span_unlink(&heap->ph_free[bin], s);
+        goto found;
+      }
+  if ((s = ph_grow(heap, npages)) == NULL)
+    return NULL;
+found:
+  /* without metadata for the rest, the whole span is used */
+  if (s->npages > npages &&
+      (rest = span_new(heap, s->start + npages, s->npages - npages))) {
+    pm_set(heap, rest->start, rest->npages, rest);
+    span_push(&heap->ph_free[PH_BIN(rest->npages)], rest);
+    s->npages = npages;
+  }
+  return s;
+}
+
+/*
+ * ph_free_pages - Free span s, coalescing it with the free spans beside
+ *                 it, and give its chunk back to the heap once the chunk
+ *                 is all free
+ */
+static void ph_free_pages(mm_heap_t *heap, span_t *s) {
+  span_t *t;
+  char *bp;
+  s->cls = PH_FREE;
+  if ((t = pm_page(heap, s->start - 1)) && t->cls == PH_FREE) {
+    span_unlink(&heap->ph_free[PH_BIN(t->npages)], t);
+    pm_set(heap, s->start, s->npages, t);
+    t->npages += s->npages;
+    free_block(heap, s);
+    s = t;
+  }
+  if ((t = pm_page(heap, s->start + s->npages)) && t->cls == PH_FREE) {
+    span_unlink(&heap->ph_free[PH_BIN(t->npages)], t);
+    pm_set(heap, t->start, t->npages, s);
+    s->npages += t->npages;
+    free_block(heap, t);
+  }
+  if (!pm_page(heap, s->start - 1) && !pm_page(heap, s->start + s->npages)) {
+    bp = PH_ADDR(heap, s->start);
+    pm_set(heap, s->start, s->npages, NULL);
+    free_block(heap, s);
+    free_block(heap, bp);
+    return;
+  }
+  span_push(&heap->ph_free[PH_BIN(s->npages)], s);
+}
+
+/*
+ * ph_malloc - Allocate an object of size bytes: a run of pages if it is
+ *             larger than PH_SLICE_MAX, else one slice of a span of its
+ *             class
+ */
+static void *ph_malloc(mm_heap_t *heap, size_t size) {
+  unsigned int cls, n;
+  size_t osize;
+  span_t *s;
+  char *bp;
+
+  if (size > PH_SLICE_MAX) {
+    if ((s = ph_alloc_pages(heap, (size + PH_PAGE - 1) >> PH_SHIFT)) == NULL)
+      return NULL;
+    s->cls = PH_RUN;
+    return PH_ADDR(heap, s->start);
+  }
+  cls = ph_class(size);
+  if ((s = heap->ph_partial[cls]) == NULL) {
+    /* the fewest objects that fill whole pages, at least PH_SPAN_BYTES */
+    osize = ph_size(cls);
+    for (n = MAX(2, PH_SPAN_BYTES / osize); (n * osize) % PH_PAGE; n++)
+      ;
+    if ((s = ph_alloc_pages(heap, (n * osize) >> PH_SHIFT)) == NULL)
+      return NULL;
+    s->cls = cls;
+    s->nfree = ((size_t)s->npages << PH_SHIFT) / osize;
+    s->objs = NULL;
+    for (bp = PH_ADDR(heap, s->start) + (s->nfree - 1) * osize;
+         bp >= PH_ADDR(heap, s->start); bp -= osize) {
+      *(char **)bp = s->objs;
+      s->objs = bp;
+    }
+    span_push(&heap->ph_partial[cls], s);
+  }
+  bp = s->objs;
+  s->objs = *(char **)bp;
+  if (--s->nfree == 0)
+    span_unlink(&heap->ph_partial[cls], s);
+  return bp;
+}
+
+/*
+ * ph_free - Free the object bp of span s. A sliced span whose objects are
+ *           all free is freed too, unless it is the last partial span of
+ *           its class.
+ */
+static void ph_free(mm_heap_t *heap, span_t *s, void *bp) {
+  span_t **list;
+  if (s->cls == PH_RUN) {
+    ph_free_pages(heap, s);
+    return;
+  }
+  list = &heap->ph_partial[s->cls];
+  *(char **)bp = s->objs;
+  s->objs = bp;
+  if (s->nfree++ == 0)
+    span_push(list, s);
+  if (s->nfree == ((size_t)s->npages << PH_SHIFT) / ph_size(s->cls) &&
+      (*list != s || s->next != NULL)) {
+    span_unlink(list, s);
+    ph_free_pages(heap, s);
+  }
+}
+
+/**************************************
+ * Movable blocks behind handles
+ *
+ *************************************/
+
+/* Handles live in the default heap, their tables in regions of their own
+ * that grow in place by an eighth at a time (see mm_meta_peak). A handle
+ * slot holds the offset of its block from heap_listp, and the lock count
+ * of the block above HLOCK_SHIFT; an unused slot holds the next unused
+ * slot, tagged with bit 0. hrev maps the offset of every movable block
+ * back to its handle. It is open addressed and probed linearly, 0 marks an
+ * empty entry, and it is kept at most HREV_FILL / 8 full. Offsets stay
+ * below HLOCK_ONE, as the memlib heap is at most MAX_HEAP bytes. */
+#define HLOCK_SHIFT 27
+#define HLOCK_ONE (1U << HLOCK_SHIFT)
+#define HSLOT_OFF(slot) ((slot) & (HLOCK_ONE - 1))
+#define HBLKP(heap, h) ((heap)->heap_listp + HSLOT_OFF((heap)->htab[h]))
+#define HSLOT_FREE(next) (((next) << 1) | 1)
+#define HSLOT_NEXT(slot) ((slot) >> 1)
+#define HTAB_MIN 16                         /* Slots of the first tables */
+#define HTAB_MAX (HLOCK_ONE / (2 * DSIZE)) /* Most blocks a heap can hold */
+#define HREV_FILL 7
+#define HREV_HASH(off) (((off) >> 3) * 2654435761U)
+
+/*
+ * hrev_find - Return the entry of hrev for the block at offset off, an
+ *             empty one if no handle points there
+ */
+static unsigned int hrev_find(mm_heap_t *heap, unsigned int off) {
+  unsigned int i = HREV_HASH(off) % heap->hrcap;
+  while (heap->hrev[i] != 0 && HSLOT_OFF(heap->htab[heap->hrev[i]]) != off)
+    if (++i == heap->hrcap)
+      i = 0;
+  return i;
+}
+
+/*
+ * hrev_add - Enter handle h under the offset of its block
+ */
+static void hrev_add(mm_heap_t *heap, mm_handle_t h) {
+  heap->hrev[hrev_find(heap, HSLOT_OFF(heap->htab[h]))] = h;
+}
+
+/*
+ * hrev_del - Take handle h out of hrev, before its block moves or goes.
+ *            The entries probed past it move back into the gap.
+ */
+static void hrev_del(mm_heap_t *heap, mm_handle_t h) {
+  unsigned int n = heap->hrcap;
+  unsigned int i = hrev_find(heap, HSLOT_OFF(heap->htab[h])), j = i, home;
+  for (;;) {
+    if (++j == n)
+      j = 0;
+    if (heap->hrev[j] == 0)
+      break;
+    home = HREV_HASH(HSLOT_OFF(heap->htab[heap->hrev[j]])) % n;
+    /* the entry at j can fill i if i is on its probe path from home */
+    if ((j + n - home) % n >= (j + n - i) % n) {
+      heap->hrev[i] = heap->hrev[j];
+      i = j;
+    }
+  }
+  heap->hrev[i] = 0;
+}
+
+/*
+ * htab_grow - Make the handle table an eighth larger and chain the new
+ *             slots onto the unused list. Return -1 on error.
+ */
+static int htab_grow(mm_heap_t *heap) {
+  unsigned int i, hcap = heap->hcap, ncap = hcap + MAX(hcap / 8, HTAB_MIN);
+  if (htab_mem == NULL &&
+      (htab_mem = mem_region_create(HTAB_MAX * sizeof(*heap->htab))) == NULL)
+    return -1;
+  if (ncap > HTAB_MAX ||
+      mem_region_sbrk(htab_mem, (ncap - hcap) * sizeof(*heap->htab)) ==
+          (void *)-1)
+    return -1;
+  heap->htab = mem_region_lo(htab_mem);
+  for (i = MAX(hcap, 1); i < ncap; i++)
+    heap->htab[i] = HSLOT_FREE(i + 1 < ncap ? i + 1 : 0);
+  heap->hfree = MAX(hcap, 1);
+  heap->hcap = ncap;
+  return 0;
+}
+
+/*
+ * hrev_grow - Make hrev an eighth larger and enter the handles in use
+ *             anew. Return -1 on error.
+ */
+static int hrev_grow(mm_heap_t *heap) {
+  unsigned int h, n = MAX(heap->hrcap / 8, HTAB_MIN);
+  if (hrev_mem == NULL &&
+      (hrev_mem = mem_region_create(2 * HTAB_MAX * sizeof(*heap->hrev))) ==
+          NULL)
+    return -1;
+  if (heap->hrcap + n > 2 * HTAB_MAX ||
+      mem_region_sbrk(hrev_mem, n * sizeof(*heap->hrev)) == (void *)-1)
+    return -1;
+  heap->hrev = mem_region_lo(hrev_mem);
+  heap->hrcap += n;
+  memset(heap->hrev, 0, heap->hrcap * sizeof(*heap->hrev));
+  for (h = 1; h < heap->hcap; h++)
+    if (!(heap->htab[h] & 1))
+      hrev_add(heap, h);
+  return 0;
+}
+
+/*
+ * block_handle - Return the handle of the movable block bp
+ */
+static mm_handle_t block_handle(mm_heap_t *heap, void *bp) {
+  return heap->hrev[hrev_find(heap, ADDR_SUB(bp, heap->heap_listp))];
+}
+
+/*
+ * can_move - Return whether bp is a movable block that is not locked
+ */
+static int can_move(mm_heap_t *heap, void *bp) {
+  return GET_ALLOC(HDRP(bp)) && GET_MOVABLE(HDRP(bp)) &&
+         heap->htab[block_handle(heap, bp)] < HLOCK_ONE;
+}
+
+/*
+ * at_top - Return whether only free space lies between bp and the end of
+ *          the heap
+ */
+static int at_top(void *bp) {
+  char *next = NEXT_BLKP(bp);
+  return GET_SIZE(HDRP(next)) == 0 ||
+         (!GET_ALLOC(HDRP(next)) && GET_SIZE(HDRP(NEXT_BLKP(next))) == 0);
+}
+
+/*
+ * halloc_block - Allocate a movable block with size bytes of data for
+ *                handle h
+ */
+static char *halloc_block(mm_heap_t *heap, size_t size, mm_handle_t h) {
+  char *bp = malloc_region(heap, MAX(size, 1), REGION_LONG);
+  if (bp == NULL)
+    return NULL;
+  PUT(HDRP(bp), GET(HDRP(bp)) | MOVABLE);
+  PUT(FTRP(bp), GET(FTRP(bp)) | MOVABLE);
+  heap->htab[h] = ADDR_SUB(bp, heap->heap_listp);
+  hrev_add(heap, h);
+  return bp;
+}
+
+/*
+ * mm_halloc - Allocate a movable object of size bytes and return its
+ *             handle, or 0 on error
+ */
+mm_handle_t mm_halloc(size_t size) {
+  mm_heap_t *heap = &mm_default;
+  mm_handle_t h;
+  if (heap->heap_listp == 0) {
+    mm_init();
+  }
+  if (heap->hfree == 0 && htab_grow(heap) < 0)
+    return 0;
+  if (8 * (heap->hlive + 1) > HREV_FILL * heap->hrcap && hrev_grow(heap) < 0)
+    return 0;
+  h = heap->hfree;
+  heap->hfree = HSLOT_NEXT(heap->htab[h]);
+  if (halloc_block(heap, size, h) == NULL) {
+    heap->htab[h] = HSLOT_FREE(heap->hfree);
+    heap->hfree = h;
+    return 0;
+  }
+  heap->hlive++;
+  return h;
+}
+
+/*
+ * mm_hfree - Free the object behind handle h and the handle itself
+ */
+void mm_hfree(mm_handle_t h) {
+  mm_heap_t *heap = &mm_default;
+  if (h == 0)
+    return;
+  hrev_del(heap, h);
+  free_block(heap, HBLKP(heap, h));
+  heap->htab[h] = HSLOT_FREE(heap->hfree);
+  heap->hfree = h;
+  heap->hlive--;
+}
+
+/*
+ * mm_hrealloc - Resize the object behind handle h, keeping the handle.
+ *               The object must not be locked. Return -1 on error.
+ */
+int mm_hrealloc(mm_handle_t h, size_t size) {
+  mm_heap_t *heap = &mm_default;
+  char *oldbp = HBLKP(heap, h);
+  size_t oldsize = GET_SIZE(HDRP(oldbp)) - DSIZE;
+  char *bp;
+  /* it grows where it is if the space after it is free */
+  if (size > oldsize && grow_block(heap, oldbp, ADJUST(size)))
+    return 0;
+  hrev_del(heap, h);
+  if ((bp = halloc_block(heap, size, h)) == NULL) {
+    hrev_add(heap, h);
+    return -1;
+  }
+  wide_copy(bp, oldbp, MIN(oldsize, size));
+  free_block(heap, oldbp);
+  return 0;
+}
+
+/*
+ * mm_hlock - Pin the object behind handle h and return its address,
+ *            which stays valid until the matching mm_hunlock. Locks nest
+ *            up to 31 deep.
+ */
+void *mm_hlock(mm_handle_t h) {
+  mm_default.htab[h] += HLOCK_ONE;
+  return HBLKP(&mm_default, h);
+}
+
+/*
+ * mm_hunlock - Let compaction move the object behind handle h again
+ */
+void mm_hunlock(mm_handle_t h) { mm_default.htab[h] -= HLOCK_ONE; }
+
+/*
+ * mm_meta_peak - Peak bytes of the handle tables since mm_init
+ */
+size_t mm_meta_peak(void) {
+  return (htab_mem ? mem_region_peak(htab_mem) : 0) +
+         (hrev_mem ? mem_region_peak(hrev_mem) : 0);
+}
+
+/*
+ * mm_compact - Close gaps by sliding unlocked movable blocks down into
+ *              the free block in front of them, then lift the last
+ *              blocks of the heap into holes further down, at most
+ *              maxmoves times in all, and give the free tail of the heap
+ *              back. Return the number of blocks moved.
+ */
+size_t mm_compact(size_t maxmoves) {
+  mm_heap_t *heap = &mm_default;
+  size_t moves = 0;
+  char *bp;
+  if (heap->heap_listp == 0)
+    return 0;
+  quick_flush(heap);
+  reserve_flush(heap);
+  bp = NEXT_BLKP(heap->heap_listp);
+  while (GET_SIZE(HDRP(bp)) && moves < maxmoves) {
+    char *next = NEXT_BLKP(bp);
+    /* the last block stays where it can still grow in place, lift moves
+     * it only into a hole that holds it */
+    if (!GET_ALLOC(HDRP(bp)) && can_move(heap, next) && !at_top(next) &&
+        GET_REGION(HDRP(next)) == GET_REGION(HDRP(bp))) {
+      bp = slide(heap, bp);
+      moves++;
+    } else {
+      bp = next;
+    }
+  }
+  while (moves < maxmoves && lift(heap))
+    moves++;
+  trim_heap(heap);
+  return moves;
+}
+
+/*
+ * slide - Move the movable block after free block fbp down to fbp and
+ *         return the free block that is left behind it
+ */
+static void *slide(mm_heap_t *heap, void *fbp) {
+  char *bp = fbp;
+  char *mbp = NEXT_BLKP(bp);
+  size_t fsize = GET_SIZE(HDRP(bp));
+  unsigned int tags = GET(HDRP(mbp));
+  unsigned int region = GET_REGION(HDRP(mbp));
+  mm_handle_t h = block_handle(heap, mbp);
+
+  hrev_del(heap, h);
+  delete_free_block(heap, bp);
+  memmove(bp, mbp, GET_SIZE(HDRP(mbp)) - DSIZE);
+  PUT(HDRP(bp), tags);
+  PUT(FTRP(bp), tags);
+  heap->htab[h] = ADDR_SUB(bp, heap->heap_listp);
+  hrev_add(heap, h);
+
+  bp = NEXT_BLKP(bp);
+  PUT(HDRP(bp), PACKR(fsize, region, 0));
+  PUT(FTRP(bp), PACKR(fsize, region, 0));
+  return coalesce(heap, bp);
+}
+
+/*
+ * lift - Move the last allocated block of the heap, if it is movable and
+ *        not locked, into the smallest free block below it that holds it,
+ *        however many blocks lie between. Return 0 if it cannot.
+ */
+static int lift(mm_heap_t *heap) {
+  char *bp = PREV_BLKP((char *)mem_region_hi(heap->mem) + 1);
+  char *fbp, *dst = NULL;
+  size_t size, best = (size_t)-1;
+  mm_handle_t h;
+
+  if (!GET_ALLOC(HDRP(bp)))
+    bp = PREV_BLKP(bp);
+  if (!can_move(heap, bp))
+    return 0;
+  size = GET_SIZE(HDRP(bp));
+  for (fbp = FR_LIST(heap, REGION_LONG); fbp != NULL;
+       fbp = GET(NEXT_FRBP(fbp)) ? fbp + (int)GET(NEXT_FRBP(fbp)) : NULL) {
+    size_t fsize = GET_SIZE(HDRP(fbp));
+    if (fbp < bp && fsize >= size && fsize < best) {
+      dst = fbp;
+      best = fsize;
+      if (fsize == size)
+        break;
+    }
+  }
+  if (dst == NULL)
+    return 0;
+
+  h = block_handle(heap, bp);
+  hrev_del(heap, h);
+  place(heap, dst, size);
+  PUT(HDRP(dst), GET(HDRP(dst)) | MOVABLE);
+  PUT(FTRP(dst), GET(FTRP(dst)) | MOVABLE);
+  wide_copy(dst, bp, size - DSIZE);
+  heap->htab[h] = ADDR_SUB(dst, heap->heap_listp);
+  hrev_add(heap, h);
+  free_block(heap, bp);
+  return 1;
+}
+
+/*
+ * trim_heap - Shrink the heap by the free block at its end, if any, and
+ *             release the pages it covered
+ */
+static void trim_heap(mm_heap_t *heap) {
+  char *bp = PREV_BLKP((char *)mem_region_hi(heap->mem) + 1);
+  size_t size = GET_SIZE(HDRP(bp));
+  if (GET_ALLOC(HDRP(bp)))
+    return;
+  delete_free_block(heap, bp);
+  mem_region_sbrk(heap->mem, -(int)size);
+  PUT(HDRP(bp), PACK(0, 1)); /* New epilogue header */
+  mem_region_release(heap->mem, bp, size);
+}
+
+/**************************************
+ * CHECK heap functions
+ *
+ *************************************/
+
+/*
+ * Return whether the pointer is aligned.
+ * May be useful for debugging.
+ */
+
+void mm_checkheap(int lineno) { checkheap(&mm_default, lineno); }
+
+/*
+ * checkheap - Check the blocks and free lists of heap
+ */
+static void checkheap(mm_heap_t *heap, int lineno) {
+  /* check heap */
+  printf("check heap\n");
+  char *p = heap->heap_listp;
+  /* Check epilogue block */
+  if (GET_SIZE(HDRP(p)) == DSIZE)
+    printf("epilogue blocks is OK\n");
+  int cnt = 0;
+  unsigned int region = 0;
+  while (GET_SIZE(HDRP(p))) {
     p = NEXT_BLKP(p);
     /* Check each block’s address alignment */
     if (((size_t)p % 8)) {
@@ -358,48 +2663,90 @@ void mm_checkheap(int lineno) {
     if (GET(HDRP(p)) != GET(FTRP(p)) && GET_SIZE(HDRP(p))) {
       printf("block %p header and footer is not consistent\n", p);
     }
-    /* Check coalescing: no two consecutive free blocks in the heap */
-    if (GET_ALLOC(HDRP(p))) {
+    /* Check coalescing: no two consecutive free blocks of one region */
+    if (GET_ALLOC(HDRP(p)) || GET_REGION(HDRP(p)) != region) {
       cnt = 0;
-    } else {
+    }
+    region = GET_REGION(HDRP(p));
+    if (!GET_ALLOC(HDRP(p))) {
       cnt++;
       if (cnt == 2)
         printf("two consecutive free blocks in the heap\n");
     }
-    if (((void *)p < mem_heap_lo() || (void *)p > mem_heap_hi()) &&
+    if (((void *)p < mem_region_lo(heap->mem) ||
+         (void *)p > mem_region_hi(heap->mem)) &&
         GET_SIZE(HDRP(p)))
       printf("%p out of heap\n", p);
+    if (GET_ALLOC(HDRP(p)) && GET_MOVABLE(HDRP(p)) &&
+        (heap->hcap == 0 || block_handle(heap, p) == 0))
+      printf("movable block %p has no handle\n", p);
   }
   /* Check epilogue and prologue blocks */
   printf("prologue blocks is OK\n");
   /* check free list */
-  printf("check free list\n");
-  if (fr_listp == 0)
-    printf("free list is empty\n");
-  else {
-    char *tmp = fr_listp;
+  int i;
+  for (i = 0; i < NREGIONS; i++) {
+    printf("check free list %d\n", i);
+    char *listp = heap->fr_listp[i];
+    if (listp == 0) {
+      printf("free list is empty\n");
+      continue;
+    }
+    char *tmp = listp;
     while (GET(NEXT_FRBP(tmp))) {
       /* check if consistent */
       if (GET(PREV_FRBP(tmp)) !=
               -GET(NEXT_FRBP(tmp + (int)GET(PREV_FRBP(tmp)))) &&
-          tmp != fr_listp)
+          tmp != listp)
         printf("inconsistent with previous block\n");
       if (GET(NEXT_FRBP(tmp)) !=
           -GET(PREV_FRBP(tmp + (int)GET(NEXT_FRBP(tmp)))))
         printf("inconsistent with next block\n");
       if (GET_ALLOC(tmp))
         printf("%p this block has been alloced\n", tmp);
+      /* check if in the right region */
+      if (GET_REGION(HDRP(tmp)) >> 1 != (unsigned int)i)
+        printf("%p is on the free list of another region\n", tmp);
       tmp = tmp + (int)(GET(tmp));
     }
     if (GET(PREV_FRBP(tmp)) !=
             -GET(NEXT_FRBP(tmp + (int)GET(PREV_FRBP(tmp)))) &&
-        tmp != fr_listp)
+        tmp != listp)
       printf("inconsistent with previous block\n");
     /* check if match with block list */
     if (GET_ALLOC(tmp))
       printf("%p this block has been alloced\n", tmp);
     /* check if in heap */
-    if ((void *)tmp < mem_heap_lo() || (void *)tmp > mem_heap_hi())
+    if ((void *)tmp < mem_region_lo(heap->mem) ||
+        (void *)tmp > mem_region_hi(heap->mem))
       printf("%p out of heap\n", tmp);
   }
+  /* check the quick lists, their blocks are still marked allocated */
+  for (i = 0; i < QL_CLASSES; i++) {
+    char *bp;
+    for (bp = heap->quick[i]; bp != NULL; bp = *(char **)bp)
+      if (!GET_ALLOC(HDRP(bp)) || GET_SIZE(HDRP(bp)) != (unsigned int)i * DSIZE)
+        printf("%p is on the wrong quick list\n", bp);
+  }
+  /* and so are those on the reserve lists, the last one of a class may
+   * be a word longer */
+  for (i = 0; i < RESERVE_CLASSES; i++) {
+    char *bp;
+    for (bp = heap->reserve[i].list; bp != NULL; bp = *(char **)bp)
+      if (!GET_ALLOC(HDRP(bp)) ||
+          GET_SIZE(HDRP(bp)) < heap->reserve[i].asize ||
+          GET_SIZE(HDRP(bp)) > heap->reserve[i].asize + DSIZE)
+        printf("%p is on the wrong reserve list\n", bp);
+  }
+  /* check the free spans of the page heap */
+  for (i = 0; i < PH_BINS; i++) {
+    span_t *sp;
+    for (sp = heap->ph_free[i]; sp; sp = sp->next) {
+      if (sp->cls != PH_FREE || PH_BIN(sp->npages) != (unsigned int)i)
+        printf("span %p is on the wrong free list\n", (void *)sp);
+      if (pm_page(heap, sp->start) != sp ||
+          pm_page(heap, sp->start + sp->npages - 1) != sp)
+        printf("span %p is not in the pagemap\n", (void *)sp);
+    }
+  }
 }
\ No newline at end of file
@@ -18,7 +18,118 @@ extern void *calloc (size_t nmemb, size_t size);
 
 #endif
 
+/* The default heap by these names, in either build */
+extern void *mm_malloc(size_t size);
+extern void mm_free(void *ptr);
+
 extern int mm_init(void);
 
+/* Peak bytes of metadata kept outside the memlib heap, 0 for mm.c */
+extern size_t mm_meta_peak(void);
+
+/* Payload bytes of an allocated block, at least the size asked for */
+extern size_t mm_usable_size(void *ptr);
+
+/* A block whose payload is aligned to align, a power of two */
+extern void *mm_memalign(size_t align, size_t size);
+
+/* Lifetime hints for mm_malloc_hint */
+#define MM_SHORT_LIVED 0x1
+#define MM_LONG_LIVED 0x2
+extern void *mm_malloc_hint(size_t size, int hint);
+
+/* Movable objects behind handles; lock an object to get its address */
+typedef unsigned int mm_handle_t;
+extern mm_handle_t mm_halloc(size_t size);
+extern void mm_hfree(mm_handle_t h);
+extern int mm_hrealloc(mm_handle_t h, size_t size);
+extern void *mm_hlock(mm_handle_t h);
+extern void mm_hunlock(mm_handle_t h);
+extern size_t mm_compact(size_t maxmoves);
+
+/* Release the pages of idle free blocks, see mm.c */
+extern size_t mm_scavenge(void);
+extern void mm_set_scavenge(int enable);
+
+/* Serve 1 KB to 256 KB requests from page spans, see mm.c */
+extern void mm_set_pageheap(int enable);
+
+/* Start payloads of 64 bytes or more on a cache line, see mm.c */
+extern void mm_set_linealign(int enable);
+
+/* Copy moved blocks with the wide copy engine (default) or memcpy */
+extern void mm_set_widecopy(int enable);
+
+/* Pick placement policies by workload phase, see mm.c */
+extern void mm_set_adaptive(int enable);
+
+/* Requests of up to MM_CLASS_MAX bytes whose size is a compile-time
+ * constant go to the block size class of mm_malloc_class directly, see
+ * mm.c; MM_CLASS is the block size in 8 byte units, tags included.
+ * mm_free_fast takes the size the block was allocated with and keeps
+ * such blocks for the next mm_malloc_fast of their class. */
+#define MM_CLASS_MAX 120
+#define MM_CLASS(size) ((size) <= 8 ? 2 : ((size) + 15) / 8)
+extern void *mm_malloc_class(size_t size, unsigned int cls);
+extern void mm_free_class(void *ptr);
+static inline __attribute__((always_inline)) void *
+mm_malloc_fast(size_t size) {
+  if (__builtin_constant_p(size) && size > 0 && size <= MM_CLASS_MAX)
+    return mm_malloc_class(size, MM_CLASS(size));
+  return mm_malloc(size);
+}
+static inline __attribute__((always_inline)) void
+mm_free_fast(void *ptr, size_t size) {
+  if (__builtin_constant_p(size) && size > 0 && size <= MM_CLASS_MAX)
+    mm_free_class(ptr);
+  else
+    mm_free(ptr);
+}
+
+/* Set blocks for count requests of size bytes, or a free block of size
+ * bytes, aside with their pages faulted in, see mm.c */
+extern int mm_reserve(size_t size, size_t count);
+extern int mm_reserve_bytes(size_t size);
+
+/* Soft limit on the size of the heap, see mm.c. A reclaim callback is
+ * given the bytes the heap is short of and returns the bytes it freed */
+typedef size_t (*mm_reclaim_fn)(size_t need);
+typedef struct mm_limit_stats {
+  size_t limit;         /* Soft limit in bytes, 0 if none */
+  size_t pressure;      /* Requests that would have grown the heap past it */
+  size_t trims;         /* Times quick lists were coalesced, pages released */
+  size_t trim_fits;     /* Times the request fitted after that */
+  size_t trim_bytes;    /* Bytes of free pages released */
+  size_t reclaims;      /* Calls of reclaim callbacks */
+  size_t reclaim_fits;  /* Times the request fitted after one */
+  size_t reclaim_bytes; /* Bytes the callbacks said they freed */
+  size_t grows;         /* Times the heap grew past the limit anyway */
+  size_t fails;         /* Times it could not grow and the request failed */
+} mm_limit_stats_t;
+extern int mm_set_soft_limit(size_t bytes, mm_reclaim_fn reclaim);
+extern void mm_limit_stats(mm_limit_stats_t *st);
+
 /* This is largely for debugging. */
 extern void mm_checkheap(int lineno);
+
+/* Independent heaps, each in its own memlib region (see memlib.h) */
+typedef struct mm_heap mm_heap_t;
+struct mem_region;
+extern mm_heap_t *mm_heap_create(struct mem_region *mem);
+/* Persistent heaps in file backed regions, see mm.c */
+extern mm_heap_t *mm_heap_open(struct mem_region *mem);
+extern void *mm_heap_root(mm_heap_t *heap);
+extern void mm_heap_set_root(mm_heap_t *heap, void *root);
+/* Heaps in shared memory, used by several processes at once; blocks are
+ * passed between them as offsets */
+extern mm_heap_t *mm_heap_shared(struct mem_region *mem);
+extern void mm_heap_close(mm_heap_t *heap);
+extern size_t mm_heap_offset(mm_heap_t *heap, void *ptr);
+extern void *mm_heap_at(mm_heap_t *heap, size_t off);
+extern void *mm_heap_malloc(mm_heap_t *heap, size_t size);
+extern void *mm_heap_malloc_hint(mm_heap_t *heap, size_t size, int hint);
+extern void *mm_heap_memalign(mm_heap_t *heap, size_t align, size_t size);
+extern void mm_heap_free(mm_heap_t *heap, void *ptr);
+extern void *mm_heap_realloc(mm_heap_t *heap, void *ptr, size_t size);
+extern size_t mm_heap_scavenge(mm_heap_t *heap);
+extern void mm_heap_checkheap(mm_heap_t *heap, int lineno);
@@ -0,0 +1,91 @@
+/*
+ * mmpmr.cc
+ * std::pmr::memory_resource adapters over mm:
+ * 1) mm_memory_resource makes a memlib region and an mm heap in it, and
+ *    serves every allocation from that heap, so the blocks of the
+ *    containers using it are kept apart from the rest of the program and
+ *    all go away at once with the resource;
+ * 2) mm_arena_resource bump-allocates from an mm arena, the mm
+ *    counterpart of std::pmr::monotonic_buffer_resource;
+ * 3) payloads are 8-byte aligned; larger alignments go to
+ *    mm_heap_memalign, or are bumped to in the arena.
+ */
+#include <new>
+
+#include "mmpmr.h"
+
+#define ALIGNMENT 8
+
+/*
+ * mm_memory_resource - Make the region and the heap in it
+ */
+mm_memory_resource::mm_memory_resource(size_t maxsize) {
+  if ((mem_ = mem_region_create(maxsize)) == NULL)
+    throw std::bad_alloc();
+  if ((heap_ = mm_heap_create(mem_)) == NULL) {
+    mem_region_destroy(mem_);
+    throw std::bad_alloc();
+  }
+}
+
+mm_memory_resource::~mm_memory_resource() { mem_region_destroy(mem_); }
+
+/*
+ * do_allocate - A block of bytes aligned to align from the heap
+ */
+void *mm_memory_resource::do_allocate(size_t bytes, size_t align) {
+  void *p;
+
+  if (bytes == 0)
+    bytes = 1;
+  p = align <= ALIGNMENT ? mm_heap_malloc(heap_, bytes)
+                         : mm_heap_memalign(heap_, align, bytes);
+  if (p == NULL)
+    throw std::bad_alloc();
+  return p;
+}
+
+/*
+ * do_deallocate - Give the block back to the heap
+ */
+void mm_memory_resource::do_deallocate(void *p, size_t bytes, size_t align) {
+  mm_heap_free(heap_, p);
+}
+
+/*
+ * do_is_equal - Blocks can only go back to the resource they came from
+ */
+bool mm_memory_resource::do_is_equal(
+    const std::pmr::memory_resource &other) const noexcept {
+  return this == &other;
+}
+
+/*
+ * mm_arena_resource - Make the arena
+ */
+mm_arena_resource::mm_arena_resource(size_t chunksize) {
+  if ((arena_ = mm_arena_create(chunksize)) == NULL)
+    throw std::bad_alloc();
+}
+
+mm_arena_resource::~mm_arena_resource() { mm_arena_destroy(arena_); }
+
+/*
+ * do_allocate - Bump bytes off the arena, with room to align them
+ */
+void *mm_arena_resource::do_allocate(size_t bytes, size_t align) {
+  size_t pad = align > ALIGNMENT ? align - ALIGNMENT : 0;
+  char *p;
+
+  if ((p = (char *)mm_arena_alloc(arena_, bytes + pad)) == NULL)
+    throw std::bad_alloc();
+  return (void *)(((size_t)p + align - 1) & ~(align - 1));
+}
+
+/*
+ * do_is_equal - Blocks can only go back to the resource they came from
+ */
+bool mm_arena_resource::do_is_equal(
+    const std::pmr::memory_resource &other) const noexcept {
+  return this == &other;
+}
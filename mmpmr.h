@@ -0,0 +1,63 @@
+/*
+ * mmpmr.h - std::pmr::memory_resource adapters over mm
+ */
+#include <cstddef>
+#include <memory_resource>
+
+extern "C" {
+#include "arena.h"
+#include "memlib.h"
+#include "mm.h"
+}
+
+/* Default largest size of the heap of an mm_memory_resource */
+#define MM_PMR_MAXSIZE ((size_t)1 << 30)
+
+/* A resource with an mm heap of its own, in its own memlib region */
+class mm_memory_resource : public std::pmr::memory_resource {
+public:
+  /* Throws std::bad_alloc if the region or heap cannot be made */
+  explicit mm_memory_resource(size_t maxsize = MM_PMR_MAXSIZE);
+  /* Unmaps the region, with every block still allocated from it */
+  ~mm_memory_resource() override;
+  mm_memory_resource(const mm_memory_resource &) = delete;
+  mm_memory_resource &operator=(const mm_memory_resource &) = delete;
+
+  mm_heap_t *heap() const { return heap_; }
+  /* High water mark of the heap size */
+  size_t peak_bytes() const { return mem_region_peak(mem_); }
+
+protected:
+  void *do_allocate(size_t bytes, size_t align) override;
+  void do_deallocate(void *p, size_t bytes, size_t align) override;
+  bool do_is_equal(const std::pmr::memory_resource &other) const
+      noexcept override;
+
+private:
+  mem_region_t *mem_;
+  mm_heap_t *heap_;
+};
+
+/* A monotonic resource over an mm arena (see arena.h) in the default mm
+ * heap: deallocate does nothing, release rewinds the arena */
+class mm_arena_resource : public std::pmr::memory_resource {
+public:
+  /* Chunks of chunksize bytes (0: the arena default); throws
+   * std::bad_alloc if the arena cannot be made */
+  explicit mm_arena_resource(size_t chunksize = 0);
+  ~mm_arena_resource() override;
+  mm_arena_resource(const mm_arena_resource &) = delete;
+  mm_arena_resource &operator=(const mm_arena_resource &) = delete;
+
+  /* Free everything allocated so far, keeping the chunks for reuse */
+  void release() { mm_arena_reset(arena_); }
+
+protected:
+  void *do_allocate(size_t bytes, size_t align) override;
+  void do_deallocate(void *p, size_t bytes, size_t align) override {}
+  bool do_is_equal(const std::pmr::memory_resource &other) const
+      noexcept override;
+
+private:
+  mm_arena_t *arena_;
+};
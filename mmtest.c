@@ -0,0 +1,835 @@
+/*
+ * mmtest.c - Tests of the parts of mm the driver traces do not reach.
+ *
+ *   -f  a heap in a file, filled, closed and reopened at another address
+ *       (mm_heap_open), twice, with every payload checked each time, and
+ *       the pages scavenged from it punched out of the file;
+ *   -s  a heap in shared memory made by several processes at once, one
+ *       used by several processes at once, then by processes killed while
+ *       they churn it, so many of them die holding its lock, which the
+ *       survivor must recover (mm_heap_shared);
+ *   -l  the three stages of the soft limit: a request that fits once the
+ *       heap is trimmed, requests that fit once the reclaim callback frees
+ *       memory, and requests that grow the heap past the limit when there
+ *       is nothing left to reclaim (mm_set_soft_limit);
+ *   -r  blocks set aside by mm_reserve: they tile the space they were cut
+ *       from, and are passed over while mm hands out line-aligned blocks,
+ *       as are blocks left on the quick lists from before;
+ *   -o  an object cache (mm_cache_create): every slot is constructed once,
+ *       objects keep their constructed state across free and alloc, and
+ *       reaping or destroying the cache destructs each of them once;
+ *   -c  constant sizes (mm_malloc_fast, mm_free_fast): blocks freed are
+ *       taken again as they are, also in adaptive mode, and none of them
+ *       is handed out once lines are aligned.
+ *
+ * With no option every test runs. Each test runs in a child process of
+ * its own, so each starts from a fresh default heap and a crash fails
+ * just that test. The exit status is the number of tests that failed.
+ */
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "memlib.h"
+#include "mm.h"
+#include "objcache.h"
+
+#define FILE_MAX (1 << 26)  /* Most bytes of the file heap */
+#define FILE_BLOCKS 2000    /* Blocks made in the file heap */
+#define SHM_MAX (1 << 26)   /* Most bytes of the shared heap */
+#define SHM_PROCS 4         /* Processes using the shared heap at once */
+#define SHM_SLOTS 64        /* Live blocks of each of them */
+#define SHM_OPS 20000       /* malloc and free calls of each */
+#define SHM_KILLS 50        /* Processes killed while they churn */
+#define SHM_RACES 100       /* New heaps attached to by all at once */
+#define LIMIT_CACHE 1000    /* Blocks the reclaim callback can drop */
+#define QUICK_BLOCKS 64     /* Small blocks freed before line-aligning */
+#define OBJS 1000           /* Objects taken from the object cache */
+#define OBJ_LIVE 0x6f626a21 /* Magic of a constructed object */
+#define OBJ_DEAD 0x64656164 /* and of a destructed one */
+#define CLASS_BLOCKS 256    /* Blocks of each constant size */
+
+/* Live blocks of a heap, as offsets from the start of its region */
+struct table {
+    size_t off[FILE_BLOCKS];
+    size_t size[FILE_BLOCKS];
+};
+
+/* Root of the shared heap: a row of slots per process, the last row for
+ * the process that made the heap, and one for the killed ones */
+struct shm_root {
+    size_t off[SHM_PROCS + 2][SHM_SLOTS];
+    size_t size[SHM_PROCS + 2][SHM_SLOTS];
+};
+
+static void test_file(void);
+static void test_shared(void);
+static void test_limit(void);
+static void test_reserve(void);
+static void test_objcache(void);
+static void test_class(void);
+static void fill(char *bp, size_t size, unsigned int seed);
+static int check(char *bp, size_t size, unsigned int seed);
+static void fail(const char *fmt, ...);
+static void usage(void);
+
+static const struct {
+    int opt;
+    const char *name;
+    void (*run)(void);
+} tests[] = {
+    {'f', "file heap reopen", test_file},
+    {'s', "shared heap", test_shared},
+    {'l', "soft limit", test_limit},
+    {'r', "reserve", test_reserve},
+    {'o', "object cache", test_objcache},
+    {'c', "constant sizes", test_class},
+};
+#define NTESTS (int)(sizeof(tests) / sizeof(tests[0]))
+
+int main(int argc, char **argv)
+{
+    int c, i, status, failed = 0;
+    int run[NTESTS] = {0}, any = 0;
+    pid_t pid;
+
+    while ((c = getopt(argc, argv, "fslroch")) != EOF) {
+        for (i = 0; i < NTESTS; i++)
+            if (c == tests[i].opt)
+                break;
+        if (i < NTESTS) {
+            run[i] = any = 1;
+            continue;
+        }
+        usage();
+        exit(c == 'h' ? 0 : 1);
+    }
+
+    for (i = 0; i < NTESTS; i++) {
+        if (any && !run[i])
+            continue;
+        fflush(stdout);
+        if ((pid = fork()) < 0) {
+            perror("fork");
+            exit(1);
+        }
+        if (pid == 0) {
+            tests[i].run();
+            exit(0);
+        }
+        waitpid(pid, &status, 0);
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+            printf("%-20s ok\n", tests[i].name);
+        } else {
+            printf("%-20s FAILED\n", tests[i].name);
+            failed++;
+        }
+    }
+    return failed;
+}
+
+/*
+ * file_open - Open the heap in the file at path, mapped away from avoid
+ *             if that is not NULL
+ */
+static mm_heap_t *file_open(const char *path, mem_region_t **r, void *avoid)
+{
+    void *spacer = MAP_FAILED;
+    mm_heap_t *heap;
+
+    /* the old mapping is gone; keep its range taken so the region moves */
+    if (avoid != NULL)
+        spacer = mmap(avoid, FILE_MAX, PROT_NONE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if ((*r = mem_region_open(path, FILE_MAX, NULL)) == NULL)
+        fail("cannot open %s", path);
+    if (spacer != MAP_FAILED)
+        munmap(spacer, FILE_MAX);
+    if ((heap = mm_heap_open(*r)) == NULL)
+        fail("%s holds no heap", path);
+    return heap;
+}
+
+/*
+ * file_check - Check every live block of the table in the heap at lo
+ */
+static void file_check(struct table *t, char *lo)
+{
+    int i;
+
+    for (i = 0; i < FILE_BLOCKS; i++)
+        if (t->off[i] && !check(lo + t->off[i], t->size[i], i))
+            fail("block %d garbled after reopen", i);
+}
+
+/*
+ * test_file - Fill a file heap, reopen it elsewhere, change it, reopen
+ *             it again; the blocks must survive each time
+ */
+static void test_file(void)
+{
+    char path[] = "/tmp/mmtestXXXXXX";
+    mem_region_t *r;
+    mm_heap_t *heap;
+    struct table *t;
+    struct stat before, after;
+    size_t released;
+    char *lo, *bp, *old;
+    int fd, i;
+
+    if ((fd = mkstemp(path)) < 0)
+        fail("mkstemp");
+    close(fd);
+
+    /* a new heap: blocks of assorted sizes, a third of them freed */
+    heap = file_open(path, &r, NULL);
+    lo = mem_region_lo(r);
+    if ((t = mm_heap_malloc(heap, sizeof(*t))) == NULL)
+        fail("no room for the table");
+    memset(t, 0, sizeof(*t));
+    mm_heap_set_root(heap, t);
+    for (i = 0; i < FILE_BLOCKS; i++) {
+        t->size[i] = 8 + (i * 37) % 600;
+        if ((bp = mm_heap_malloc(heap, t->size[i])) == NULL)
+            fail("out of memory");
+        fill(bp, t->size[i], i);
+        t->off[i] = bp - lo;
+    }
+    for (i = 0; i < FILE_BLOCKS; i += 3) {
+        mm_heap_free(heap, lo + t->off[i]);
+        t->off[i] = 0;
+    }
+    mem_region_sync(r);
+    mem_region_destroy(r);
+
+    /* reopened at another address: free some more, add new ones and one
+     * large block, which makes the file grow */
+    old = lo;
+    heap = file_open(path, &r, old);
+    lo = mem_region_lo(r);
+    if (lo == old)
+        fail("heap reopened at the same address");
+    if ((t = mm_heap_root(heap)) == NULL)
+        fail("root lost");
+    file_check(t, lo);
+    for (i = 1; i < FILE_BLOCKS; i += 3) {
+        mm_heap_free(heap, lo + t->off[i]);
+        t->off[i] = 0;
+    }
+    for (i = 0; i < FILE_BLOCKS; i += 3) {
+        t->size[i] = 16 + (i * 53) % 900;
+        if ((bp = mm_heap_malloc(heap, t->size[i])) == NULL)
+            fail("out of memory");
+        fill(bp, t->size[i], i);
+        t->off[i] = bp - lo;
+    }
+    if ((bp = mm_heap_malloc(heap, 2 << 20)) == NULL)
+        fail("no large block");
+    fill(bp, 2 << 20, FILE_BLOCKS);
+    if ((bp = mm_heap_realloc(heap, bp, 4 << 20)) == NULL)
+        fail("no larger block");
+    mm_heap_free(heap, bp);
+    file_check(t, lo);
+
+    /* the pages released must leave the file, not just the mapping */
+    if (stat(path, &before) < 0 || (released = mm_heap_scavenge(heap)) == 0 ||
+        stat(path, &after) < 0)
+        fail("nothing released");
+    if ((size_t)(before.st_blocks - after.st_blocks) * 512 < (4 << 20) - 8192)
+        fail("%zu bytes released, %zu left the file", released,
+             (size_t)(before.st_blocks - after.st_blocks) * 512);
+    mem_region_sync(r);
+    mem_region_destroy(r);
+
+    /* and once more, just to look */
+    old = lo;
+    heap = file_open(path, &r, old);
+    if ((t = mm_heap_root(heap)) == NULL)
+        fail("root lost");
+    file_check(t, mem_region_lo(r));
+    mem_region_destroy(r);
+    unlink(path);
+}
+
+/*
+ * shm_churn - Allocate and free blocks in row w of the shared heap, each
+ *             checked before it is freed; forever if ops is 0
+ */
+static void shm_churn(mm_heap_t *heap, struct shm_root *root, int w,
+                      unsigned int seed, long ops)
+{
+    unsigned int k;
+    size_t off;
+    char *bp;
+    long i;
+
+    for (i = 0; ops == 0 || i < ops; i++) {
+        seed = seed * 1103515245 + 12345;
+        k = (seed >> 8) % SHM_SLOTS;
+        if ((off = root->off[w][k]) != 0) {
+            bp = mm_heap_at(heap, off);
+            if (!check(bp, root->size[w][k], w * SHM_SLOTS + k))
+                fail("process %d found block %u garbled", w, k);
+            root->off[w][k] = 0;
+            mm_heap_free(heap, bp);
+        } else {
+            root->size[w][k] = 8 + (seed >> 16) % 3000;
+            if ((bp = mm_heap_malloc(heap, root->size[w][k])) == NULL)
+                fail("process %d out of memory", w);
+            fill(bp, root->size[w][k], w * SHM_SLOTS + k);
+            root->off[w][k] = mm_heap_offset(heap, bp);
+        }
+    }
+}
+
+/*
+ * shm_attach - Map the shared heap name in a new process, at an address
+ *              that differs from process to process
+ */
+static mm_heap_t *shm_attach(const char *name, int w, struct shm_root **root)
+{
+    mem_region_t *r;
+    mm_heap_t *heap;
+
+    mmap(NULL, (size_t)(w + 1) << 20, PROT_NONE,
+         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if ((r = mem_region_shm(name, SHM_MAX)) == NULL ||
+        (heap = mm_heap_shared(r)) == NULL)
+        fail("process %d cannot attach", w);
+    if ((*root = mm_heap_root(heap)) == NULL)
+        fail("process %d sees no root", w);
+    return heap;
+}
+
+/*
+ * shm_verify - Check the blocks of rows 0 to rows - 1 of the shared heap
+ */
+static void shm_verify(mm_heap_t *heap, struct shm_root *root, int rows)
+{
+    int w, k;
+
+    for (w = 0; w < rows; w++)
+        for (k = 0; k < SHM_SLOTS; k++)
+            if (root->off[w][k] &&
+                !check(mm_heap_at(heap, root->off[w][k]), root->size[w][k],
+                       w * SHM_SLOTS + k))
+                fail("block %d of process %d garbled", k, w);
+}
+
+/*
+ * shm_race - Let several processes attach to a new shared heap at once;
+ *            one of them must make it and the others use that one
+ */
+static void shm_race(const char *name)
+{
+    struct {
+        int w;
+        size_t off;
+    } got;
+    int go[2], offs[2], w, status;
+    mem_region_t *r;
+    mm_heap_t *heap;
+    pid_t pid[SHM_PROCS];
+    char *bp, c;
+
+    shm_unlink(name);
+    if (pipe(go) < 0 || pipe(offs) < 0)
+        fail("pipe");
+    for (w = 0; w < SHM_PROCS; w++) {
+        if ((pid[w] = fork()) < 0)
+            fail("fork");
+        if (pid[w] == 0) {
+            /* wait for the end of the go pipe to close */
+            close(go[1]);
+            if (read(go[0], &c, 1) != 0)
+                fail("process %d not started", w);
+            if ((r = mem_region_shm(name, SHM_MAX)) == NULL ||
+                (heap = mm_heap_shared(r)) == NULL)
+                fail("process %d cannot attach to a new heap", w);
+            if ((bp = mm_heap_malloc(heap, 100)) == NULL)
+                fail("process %d out of memory", w);
+            fill(bp, 100, w);
+            got.w = w;
+            got.off = mm_heap_offset(heap, bp);
+            if (write(offs[1], &got, sizeof(got)) != sizeof(got))
+                fail("process %d cannot report", w);
+            exit(0);
+        }
+    }
+    close(go[0]);
+    close(go[1]);
+    close(offs[1]);
+    for (w = 0; w < SHM_PROCS; w++) {
+        waitpid(pid[w], &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            fail("process %d failed", w);
+    }
+    if ((r = mem_region_shm(name, SHM_MAX)) == NULL ||
+        (heap = mm_heap_shared(r)) == NULL)
+        fail("cannot attach to %s", name);
+    for (w = 0; w < SHM_PROCS; w++) {
+        if (read(offs[0], &got, sizeof(got)) != sizeof(got))
+            fail("lost a block");
+        if (!check(mm_heap_at(heap, got.off), 100, got.w))
+            fail("block of process %d garbled", got.w);
+    }
+    close(offs[0]);
+    mm_heap_close(heap);
+    mem_region_destroy(r);
+    shm_unlink(name);
+}
+
+/*
+ * test_shared - Let several processes make a shared heap at once, and
+ *               churn one at once, then kill processes halfway through
+ *               churning it
+ */
+static void test_shared(void)
+{
+    char name[32];
+    struct shm_root *root;
+    mem_region_t *r;
+    mm_heap_t *heap;
+    pid_t pid[SHM_PROCS], victim;
+    int w, i, status;
+
+    for (i = 0; i < SHM_RACES; i++) {
+        snprintf(name, sizeof(name), "/mmtest.%d.%d", (int)getpid(), i);
+        shm_race(name);
+    }
+
+    snprintf(name, sizeof(name), "/mmtest.%d", (int)getpid());
+    shm_unlink(name);
+    if ((r = mem_region_shm(name, SHM_MAX)) == NULL ||
+        (heap = mm_heap_shared(r)) == NULL)
+        fail("cannot make %s", name);
+    if ((root = mm_heap_malloc(heap, sizeof(*root))) == NULL)
+        fail("no room for the root");
+    memset(root, 0, sizeof(*root));
+    mm_heap_set_root(heap, root);
+    shm_churn(heap, root, SHM_PROCS, 1, SHM_SLOTS * 4);
+
+    /* every process at once, each on a row of its own */
+    for (w = 0; w < SHM_PROCS; w++) {
+        if ((pid[w] = fork()) < 0)
+            fail("fork");
+        if (pid[w] == 0) {
+            heap = shm_attach(name, w, &root);
+            shm_churn(heap, root, w, 77 + w, SHM_OPS);
+            exit(0);
+        }
+    }
+    for (w = 0; w < SHM_PROCS; w++) {
+        waitpid(pid[w], &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            fail("process %d failed", w);
+    }
+    shm_verify(heap, root, SHM_PROCS + 1);
+
+    /* processes killed at random points, about two in five of them while
+     * holding the lock. A lock left held would hang the next call here,
+     * so that is bounded by an alarm. */
+    alarm(60);
+    for (i = 0; i < SHM_KILLS; i++) {
+        if ((victim = fork()) < 0)
+            fail("fork");
+        if (victim == 0) {
+            heap = shm_attach(name, SHM_PROCS + 1, &root);
+            shm_churn(heap, root, SHM_PROCS + 1, 1000 + i, 0);
+            exit(0);
+        }
+        usleep(2000 + (i * 7919) % 8000);
+        kill(victim, SIGKILL);
+        waitpid(victim, &status, 0);
+        /* the row of the killed process may be halfway changed */
+        memset(root->off[SHM_PROCS + 1], 0, sizeof(root->off[0]));
+        shm_churn(heap, root, SHM_PROCS, 2 + i, SHM_SLOTS);
+        shm_verify(heap, root, SHM_PROCS + 1);
+    }
+    alarm(0);
+    mem_region_destroy(r);
+    shm_unlink(name);
+}
+
+/* Blocks the reclaim callback may free, and what it did */
+static char *cache[LIMIT_CACHE];
+static int ncache;
+static size_t reclaimed;
+
+/*
+ * drop - The reclaim callback: free cached blocks until need bytes are
+ *        freed or the cache is empty
+ */
+static size_t drop(size_t need)
+{
+    size_t freed = 0;
+
+    while (ncache > 0 && freed < need) {
+        ncache--;
+        if (!check(cache[ncache], 1000, ncache))
+            fail("cached block %d garbled", ncache);
+        freed += mm_usable_size(cache[ncache]);
+        mm_free(cache[ncache]);
+    }
+    reclaimed += freed;
+    return freed;
+}
+
+/*
+ * test_limit - Run the default heap into its soft limit, one stage of
+ *              pressure() at a time
+ */
+static void test_limit(void)
+{
+    static char *live[20000];
+    mm_limit_stats_t st;
+    size_t limit, size;
+    int n = 0, i;
+
+    mem_init();
+    if (mm_init() < 0)
+        fail("mm_init failed");
+    for (ncache = 0; ncache < LIMIT_CACHE; ncache++) {
+        if ((cache[ncache] = mm_malloc(1000)) == NULL)
+            fail("out of memory");
+        fill(cache[ncache], 1000, ncache);
+    }
+    /* blocks set aside, which the heap can only use once it is trimmed */
+    if (mm_reserve(4000, 16) < 0)
+        fail("mm_reserve failed");
+    limit = mem_heapsize();
+    mm_set_soft_limit(limit, drop);
+
+    /* stage 1 */
+    if ((live[n] = mm_malloc(1 << 15)) == NULL)
+        fail("out of memory");
+    fill(live[n], 1 << 15, n);
+    n++;
+    mm_limit_stats(&st);
+    if (st.pressure != 1 || st.trim_fits != 1 || st.reclaims != 0)
+        fail("trim: %zu requests under pressure, %zu fitted after a trim, "
+             "%zu reclaims", st.pressure, st.trim_fits, st.reclaims);
+
+    /* stage 2, as long as the cache lasts */
+    while (ncache > LIMIT_CACHE / 2) {
+        size = 200 + (n * 37) % 500;
+        if ((live[n] = mm_malloc(size)) == NULL)
+            fail("out of memory");
+        fill(live[n], size, n);
+        n++;
+    }
+    mm_limit_stats(&st);
+    if (st.reclaims == 0 || st.reclaim_fits == 0 ||
+        st.reclaim_bytes != reclaimed || st.grows != 0)
+        fail("reclaim: %zu calls, %zu fits, %zu grows", st.reclaims,
+             st.reclaim_fits, st.grows);
+    if (mem_heapsize() > limit)
+        fail("heap grew past the limit with memory left to reclaim");
+
+    /* stage 3 once it is empty */
+    while (ncache > 0 || mem_heapsize() <= limit) {
+        if (n == (int)(sizeof(live) / sizeof(live[0])))
+            fail("the heap does not grow past the limit");
+        size = 200 + (n * 37) % 500;
+        if ((live[n] = mm_malloc(size)) == NULL)
+            fail("out of memory");
+        fill(live[n], size, n);
+        n++;
+    }
+    mm_limit_stats(&st);
+    if (st.grows == 0 || st.fails != 0)
+        fail("grow: %zu grows, %zu failures", st.grows, st.fails);
+
+    for (i = 0; i < n; i++)
+        if (!check(live[i], i == 0 ? 1 << 15 : 200 + (i * 37) % 500, i))
+            fail("block %d garbled", i);
+    mem_deinit();
+}
+
+/*
+ * test_reserve - Reserve blocks in a free block a word longer than they
+ *                need, and while line-aligning, which must pass over them
+ *                and over the quick lists
+ */
+static void test_reserve(void)
+{
+    char *a, *b, *bp[4], *next, *quick[QUICK_BLOCKS];
+    int i;
+
+    mem_init();
+    if (mm_init() < 0)
+        fail("mm_init failed");
+    /* a is a block of 72 bytes, four 8 byte requests take 64 of them */
+    a = mm_malloc(64);
+    b = mm_malloc(64);
+    mm_free(a);
+    if (mm_reserve(8, 4) < 0)
+        fail("mm_reserve failed");
+    for (i = 0; i < 4; i++)
+        if ((bp[i] = mm_malloc(8)) == NULL)
+            fail("out of memory");
+    for (i = 0; i < 4; i++) {
+        next = i < 3 ? bp[i + 1] : b;
+        if (bp[i] + mm_usable_size(bp[i]) + 8 != next)
+            fail("reserved block %d ends at %p, the next starts at %p", i,
+                 (void *)(bp[i] + mm_usable_size(bp[i]) + 8), (void *)next);
+    }
+
+    /* a phase of mallocs and frees taking turns, which puts freed small
+     * blocks on the quick lists once most of the heap is in use, then
+     * as many of them as fit there */
+    for (i = 0; i < 1000; i++)
+        fill(mm_malloc(1000), 1000, i);
+    mm_set_adaptive(1);
+    for (i = 0; i < 100000; i++)
+        mm_free(mm_malloc(100));
+    for (i = 0; i < QUICK_BLOCKS; i++)
+        quick[i] = mm_malloc(100);
+    for (i = 0; i < QUICK_BLOCKS; i++)
+        mm_free(quick[i]);
+
+    if (mm_reserve(200, 8) < 0)
+        fail("mm_reserve failed");
+    mm_set_linealign(1);
+    for (i = 0; i < 8; i++)
+        if ((size_t)(a = mm_malloc(200)) % 64 != 0)
+            fail("block %d at %p is not line-aligned", i, (void *)a);
+    for (i = 0; i < QUICK_BLOCKS; i++)
+        if ((size_t)(a = mm_malloc(100)) % 64 != 0)
+            fail("block %d at %p is not line-aligned", i, (void *)a);
+    mem_deinit();
+}
+
+/* An object of the object cache; in its constructed state inuse is 0 */
+struct obj {
+    unsigned int magic;
+    unsigned int inuse;
+    char data[40];
+};
+static size_t nctor, ndtor;
+
+static void obj_ctor(void *p)
+{
+    struct obj *o = p;
+
+    if (o->magic == OBJ_LIVE)
+        fail("object %p constructed twice", p);
+    o->magic = OBJ_LIVE;
+    o->inuse = 0;
+    nctor++;
+}
+
+static void obj_dtor(void *p)
+{
+    struct obj *o = p;
+
+    if (o->magic != OBJ_LIVE || o->inuse)
+        fail("object %p destructed while not in its constructed state", p);
+    o->magic = OBJ_DEAD;
+    ndtor++;
+}
+
+/*
+ * obj_take - An object of cache in its constructed state, put to use
+ */
+static struct obj *obj_take(mm_cache_t *cache, unsigned int seed)
+{
+    struct obj *o;
+
+    if ((o = mm_cache_alloc(cache)) == NULL)
+        fail("out of memory");
+    if (o->magic != OBJ_LIVE || o->inuse)
+        fail("object %p handed out unconstructed", (void *)o);
+    o->inuse = 1;
+    fill(o->data, sizeof(o->data), seed);
+    return o;
+}
+
+/*
+ * obj_give - Check an object in use and give it back constructed
+ */
+static void obj_give(mm_cache_t *cache, struct obj *o, unsigned int seed)
+{
+    if (!check(o->data, sizeof(o->data), seed))
+        fail("object %p garbled", (void *)o);
+    o->inuse = 0;
+    mm_cache_free(cache, o);
+}
+
+/*
+ * test_objcache - Take objects from a cache, give them back, take them
+ *                 again, then reap and destroy it, counting constructor
+ *                 and destructor calls
+ */
+static void test_objcache(void)
+{
+    static struct obj *objs[OBJS];
+    mm_cache_t *cache;
+    size_t made;
+    int i;
+
+    mem_init();
+    if (mm_init() < 0)
+        fail("mm_init failed");
+    if ((cache = mm_cache_create("obj", sizeof(struct obj), 0, obj_ctor,
+                                 obj_dtor)) == NULL)
+        fail("mm_cache_create failed");
+    for (i = 0; i < OBJS; i++)
+        objs[i] = obj_take(cache, i);
+    made = nctor;
+    if (made < OBJS || ndtor != 0)
+        fail("%zu objects constructed, %zu destructed", nctor, ndtor);
+
+    /* freed objects are taken again as they are, no constructor runs */
+    for (i = 0; i < OBJS; i += 2)
+        obj_give(cache, objs[i], i);
+    for (i = 0; i < OBJS; i += 2)
+        objs[i] = obj_take(cache, OBJS + i);
+    if (nctor != made || ndtor != 0)
+        fail("reuse ran %zu constructors, %zu destructors", nctor - made,
+             ndtor);
+
+    /* with every object back, reaping destructs each one once */
+    for (i = 0; i < OBJS; i++)
+        obj_give(cache, objs[i], i % 2 ? i : OBJS + i);
+    if (mm_cache_reap(cache) == 0 || ndtor != nctor)
+        fail("reap: %zu objects constructed, %zu destructed", nctor, ndtor);
+
+    /* and so does destroying a cache with objects still in use */
+    for (i = 0; i < OBJS / 2; i++)
+        objs[i] = obj_take(cache, i);
+    for (i = 0; i < OBJS / 2; i++)
+        objs[i]->inuse = 0;
+    mm_cache_destroy(cache);
+    if (ndtor != nctor)
+        fail("destroy: %zu objects constructed, %zu destructed", nctor,
+             ndtor);
+    mem_deinit();
+}
+
+/* Blocks of one constant size, and those of them freed */
+static char *cblocks[CLASS_BLOCKS], *cfreed[CLASS_BLOCKS / 2];
+
+/*
+ * class_round - Take blocks of size bytes, free every other one and take
+ *               as many again, all with the size as a constant, which the
+ *               inlining keeps it; the blocks freed must come back
+ */
+static inline __attribute__((always_inline)) void class_round(size_t size)
+{
+    int i, j;
+
+    for (i = 0; i < CLASS_BLOCKS; i++) {
+        if ((cblocks[i] = mm_malloc_fast(size)) == NULL)
+            fail("out of memory");
+        fill(cblocks[i], size, i);
+    }
+    for (i = 1; i < CLASS_BLOCKS; i += 2) {
+        cfreed[i / 2] = cblocks[i];
+        mm_free_fast(cblocks[i], size);
+    }
+    for (i = 1; i < CLASS_BLOCKS; i += 2) {
+        if ((cblocks[i] = mm_malloc_fast(size)) == NULL)
+            fail("out of memory");
+        for (j = 0; j < CLASS_BLOCKS / 2 && cfreed[j] != cblocks[i]; j++)
+            ;
+        if (j == CLASS_BLOCKS / 2)
+            fail("%zu bytes: %p is not a block freed before", size,
+                 (void *)cblocks[i]);
+        fill(cblocks[i], size, CLASS_BLOCKS + i);
+    }
+    for (i = 0; i < CLASS_BLOCKS; i++) {
+        if (!check(cblocks[i], size, i % 2 ? CLASS_BLOCKS + i : i))
+            fail("%zu bytes: block %d garbled", size, i);
+        mm_free_fast(cblocks[i], size);
+    }
+}
+
+/*
+ * test_class - Take and free blocks of constant sizes, plainly, in
+ *              adaptive mode and with lines aligned
+ */
+static void test_class(void)
+{
+    char *bp;
+    int i;
+
+    mem_init();
+    if (mm_init() < 0)
+        fail("mm_init failed");
+    class_round(1);
+    class_round(8);
+    class_round(40);
+    class_round(64);
+    class_round(120);
+    mm_set_adaptive(1);
+    class_round(40);
+    class_round(100);
+    mm_set_adaptive(0);
+
+    /* the blocks waiting for their class are not aligned */
+    mm_set_linealign(1);
+    for (i = 0; i < CLASS_BLOCKS; i++)
+        if ((size_t)(bp = mm_malloc_fast(64)) % 64 != 0)
+            fail("block %d at %p is not line-aligned", i, (void *)bp);
+    mem_deinit();
+}
+
+/*
+ * fill - Write the pattern of seed over the size bytes at bp
+ */
+static void fill(char *bp, size_t size, unsigned int seed)
+{
+    size_t j;
+
+    for (j = 0; j < size; j++)
+        bp[j] = (char)(seed * 31 + j);
+}
+
+/*
+ * check - Whether the size bytes at bp still hold the pattern of seed
+ */
+static int check(char *bp, size_t size, unsigned int seed)
+{
+    size_t j;
+
+    for (j = 0; j < size; j++)
+        if (bp[j] != (char)(seed * 31 + j))
+            return 0;
+    return 1;
+}
+
+/*
+ * fail - Report why the test failed and leave
+ */
+static void fail(const char *fmt, ...)
+{
+    va_list ap;
+
+    fprintf(stderr, "mmtest: ");
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fprintf(stderr, "\n");
+    exit(1);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: mmtest [-fslroch]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-f         Reopen a heap in a file elsewhere.\n");
+    fprintf(stderr, "\t-s         Share a heap, kill processes using it.\n");
+    fprintf(stderr, "\t-l         Run the heap into its soft limit.\n");
+    fprintf(stderr, "\t-r         Take blocks set aside by mm_reserve.\n");
+    fprintf(stderr, "\t-o         Construct and destruct cached objects.\n");
+    fprintf(stderr, "\t-c         Allocate and free constant sizes.\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "With no option every test runs.\n");
+}
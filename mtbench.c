@@ -0,0 +1,258 @@
+/*
+ * mtbench.c - Multithreaded benchmark of the mtcache front end.
+ *
+ * Models a thread pool: every thread runs a burst of random malloc and
+ * free calls over a small working set, frees what it still holds and then
+ * sits idle until all threads are done. The time of the bursts gives the
+ * throughput; the heap size and the bytes left in the caches while the
+ * threads idle give the memory overhead. Each cache mode runs in a child
+ * process of its own, so every mode starts from an empty heap.
+ *
+ * With -x the threads share one working set, so most blocks are freed by
+ * another thread than the one that allocated them and pass through the
+ * central depot.
+ *
+ * Every thread also allocates a CNT_SIZE byte counter block and bumps it
+ * once per call. The "shared" column counts the threads whose counter
+ * shares a cache line with that of another thread, which is what -a
+ * (line-aligned allocation in mm) is meant to bring to zero.
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "memlib.h"
+#include "mm.h"
+#include "mtcache.h"
+
+#define DEF_THREADS 64      /* Default number of threads (-t) */
+#define DEF_OPS 100000      /* Default malloc/free calls per thread (-n) */
+#define DEF_LIVE 64         /* Default working set per thread (-w) */
+#define CNT_SIZE 64         /* Bytes of the per-thread counter block */
+#define LINE 64             /* Cache line size */
+
+static int nthreads = DEF_THREADS;
+static int nops = DEF_OPS;
+static int nlive = DEF_LIVE;
+static int shared = 0;      /* Threads share their working sets (-x) */
+static int align = 0;       /* Line-aligned allocation (-a) */
+static void **pool;         /* The shared working set */
+static volatile long **counters; /* Counter block of each thread */
+static pthread_barrier_t start, ended, done, leave;
+
+static void run(int mode);
+static void *worker(void *arg);
+static void usage(void);
+
+int main(int argc, char **argv)
+{
+    int c, mode = -1, status;
+    pid_t pid;
+
+    while ((c = getopt(argc, argv, "t:n:w:m:xah")) != EOF) {
+        switch (c) {
+        case 't': /* Threads */
+            nthreads = atoi(optarg);
+            break;
+        case 'n': /* Calls per thread */
+            nops = atoi(optarg);
+            break;
+        case 'w': /* Working set per thread */
+            nlive = atoi(optarg);
+            break;
+        case 'm': /* Only one mode */
+            if (!strcmp(optarg, "cpu"))
+                mode = MM_MT_PERCPU;
+            else if (!strcmp(optarg, "thread"))
+                mode = MM_MT_PERTHREAD;
+            else {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'x': /* Shared working set */
+            shared = 1;
+            break;
+        case 'a': /* Line-aligned allocation */
+            align = 1;
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (nthreads < 1 || nops < 1 || nlive < 1) {
+        usage();
+        exit(1);
+    }
+
+    printf("%d threads, %d calls and %d live blocks per thread%s%s\n",
+           nthreads, nops, nlive, shared ? ", shared" : "",
+           align ? ", line-aligned" : "");
+    printf("%-8s%8s%12s%10s%10s%10s%8s%10s%8s\n", "mode", "Mops/s",
+           "heap locks", "heap KB", "cached KB", "depot KB", "caches",
+           "meta KB", "shared");
+    for (c = MM_MT_PERCPU; c <= MM_MT_PERTHREAD; c++) {
+        if (mode >= 0 && c != mode)
+            continue;
+        fflush(stdout);
+        if ((pid = fork()) < 0) {
+            perror("fork");
+            exit(1);
+        }
+        if (pid == 0) {
+            run(c);
+            exit(0);
+        }
+        waitpid(pid, &status, 0);
+    }
+    return 0;
+}
+
+/*
+ * run - Run the benchmark in one cache mode and print a line of results
+ */
+static void run(int mode)
+{
+    pthread_t *tid;
+    struct timespec t0, t1;
+    mm_mt_stats_t st;
+    double secs;
+    long i, j, nshared = 0;
+
+    mem_init();
+    mm_set_linealign(align);
+    if ((mode = mm_mt_init(mode)) < 0) {
+        fprintf(stderr, "mm_mt_init failed\n");
+        exit(1);
+    }
+    pthread_barrier_init(&start, NULL, nthreads + 1);
+    pthread_barrier_init(&ended, NULL, nthreads);
+    pthread_barrier_init(&done, NULL, nthreads + 1);
+    pthread_barrier_init(&leave, NULL, nthreads + 1);
+    pool = calloc((size_t)nthreads * nlive, sizeof(void *));
+    counters = calloc(nthreads, sizeof(long *));
+    if ((tid = calloc(nthreads, sizeof(pthread_t))) == NULL || !pool ||
+        !counters) {
+        perror("calloc");
+        exit(1);
+    }
+    for (i = 0; i < nthreads; i++)
+        if (pthread_create(&tid[i], NULL, worker, (void *)i) != 0) {
+            perror("pthread_create");
+            exit(1);
+        }
+
+    /* the clock starts before the last thread arrives at the barrier, as
+     * with fewer CPUs than threads the others may run first */
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    pthread_barrier_wait(&start);
+    pthread_barrier_wait(&done);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    /* every thread is alive but idle now */
+    mm_mt_stats(&st);
+    for (i = 0; i < nthreads; i++)
+        for (j = 0; j < nthreads; j++)
+            if (i != j &&
+                (size_t)counters[i] / LINE <=
+                    ((size_t)counters[j] + CNT_SIZE - 1) / LINE &&
+                (size_t)counters[j] / LINE <=
+                    ((size_t)counters[i] + CNT_SIZE - 1) / LINE) {
+                nshared++;
+                break;
+            }
+    pthread_barrier_wait(&leave);
+    for (i = 0; i < nthreads; i++)
+        pthread_join(tid[i], NULL);
+
+    secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    printf("%-8s%8.1f%12zu%10zu%10zu%10zu%8zu%10zu%8ld\n",
+           mode == MM_MT_PERCPU ? "cpu" : "thread",
+           (double)nthreads * nops / secs / 1e6, st.heap_locks,
+           st.heap_bytes / 1024, st.cached_bytes / 1024,
+           st.depot_bytes / 1024, st.caches, st.meta_bytes / 1024, nshared);
+    free(tid);
+    free(pool);
+    free(counters);
+    mem_deinit();
+}
+
+/*
+ * worker - One thread: a burst of random calls, then idle until told to go
+ */
+static void *worker(void *arg)
+{
+    unsigned int x = 2463534242u + (unsigned int)(long)arg * 7919;
+    void **live = pool + (long)arg * nlive, *bp;
+    int n = shared ? nthreads * nlive : nlive;
+    size_t size;
+    int i, j;
+
+    volatile long *cnt;
+
+    if (shared)
+        live = pool;
+    pthread_barrier_wait(&start);
+    if ((cnt = mm_mt_malloc(CNT_SIZE)) == NULL) {
+        fprintf(stderr, "mm_mt_malloc failed\n");
+        exit(1);
+    }
+    counters[(long)arg] = cnt;
+    for (i = 0; i < nops; i++) {
+        (*cnt)++;
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        j = x % n;
+        if ((bp = __atomic_exchange_n(&live[j], NULL, __ATOMIC_ACQ_REL))) {
+            mm_mt_free(bp);
+            continue;
+        }
+        /* mostly small blocks, now and then up to 1 KB */
+        size = 16 + ((x >> 8) % 8 ? (x >> 12) % 128 : (x >> 12) % 1024);
+        if ((bp = mm_mt_malloc(size)) == NULL) {
+            fprintf(stderr, "mm_mt_malloc failed\n");
+            exit(1);
+        }
+        *(char *)bp = (char)i;
+        /* another thread may have filled the slot meanwhile */
+        if ((bp = __atomic_exchange_n(&live[j], bp, __ATOMIC_ACQ_REL)))
+            mm_mt_free(bp);
+    }
+    /* every thread is done with the shared slots before they are freed */
+    pthread_barrier_wait(&ended);
+    for (j = 0; j < nlive; j++)
+        mm_mt_free(pool[(long)arg * nlive + j]);
+    pthread_barrier_wait(&done);
+    pthread_barrier_wait(&leave);
+    mm_mt_free((void *)cnt);
+    return NULL;
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: mtbench [-xa] [-t <threads>] [-n <calls>]"
+            " [-w <live>] [-m cpu|thread]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-t <n>     Threads in the pool (default %d).\n",
+            DEF_THREADS);
+    fprintf(stderr, "\t-n <n>     malloc and free calls per thread"
+            " (default %d).\n", DEF_OPS);
+    fprintf(stderr, "\t-w <n>     Blocks each thread keeps live"
+            " (default %d).\n", DEF_LIVE);
+    fprintf(stderr, "\t-m <mode>  Run only the per-CPU or the per-thread"
+            " caches.\n");
+    fprintf(stderr, "\t-x         Share the working set among all threads.\n");
+    fprintf(stderr, "\t-a         Align blocks of 64 bytes or more to cache"
+            " lines.\n");
+}
@@ -0,0 +1,668 @@
+/*
+ * mtcache.c
+ * thread-safe front end over the mm heap:
+ * 1) the mm heap itself is shared by all threads and guarded by one mutex;
+ * 2) requests up to SC_MAXSIZE are rounded up to a size class of
+ *    sizeclass.h. A cache keeps the free blocks of each class as an array
+ *    of pointers and a count, so most malloc and free calls never take the
+ *    mutex;
+ * 3) in MM_MT_PERCPU mode there is one cache per CPU. A push or pop checks
+ *    the CPU, moves one pointer and stores the new count as its very last
+ *    instruction, all inside a restartable sequence (rseq): if the thread
+ *    is preempted, migrated or signalled before that store, the kernel
+ *    sends it to the abort handler and the operation is retried. The fast
+ *    path needs neither atomics nor locks, and the memory held in caches
+ *    is bounded by the number of CPUs rather than of threads;
+ * 4) in MM_MT_PERTHREAD mode, or when glibc has not registered rseq, each
+ *    thread gets its own cache on first use, handed back when it exits;
+ * 5) an empty cache is refilled and a full one drained by half its
+ *    capacity at a time, through a central depot: one lock-free stack of
+ *    such batches per class. A batch is a chain of its own free blocks,
+ *    and the stack top is the 32-bit offset of the first batch from the
+ *    heap start plus a 32-bit tag bumped by every change, swapped with a
+ *    single 64-bit compare and exchange, so a pop racing with a pop and
+ *    push of the same batch (ABA) fails instead of corrupting the stack;
+ * 6) the mm heap is only locked when the depot of a class runs dry, or
+ *    holds MT_DEPOT_MAX batches already, and for requests too large for
+ *    any class;
+ * 7) fork holds the mutex across the fork, so the child gets the heap in
+ *    a consistent state and the mutex free. The depot and the per-CPU
+ *    caches change by single atomic stores and need no more; the caches
+ *    of the other threads, which do not exist in the child, are dropped.
+ */
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) && __has_include(<sys/rseq.h>)
+#include <sys/rseq.h>
+#endif
+
+#include "memlib.h"
+#include "mm.h"
+#include "mtcache.h"
+#include "sizeclass.h"
+
+/* do not change the following! */
+#ifdef DRIVER
+/* create aliases for driver tests */
+#define malloc mm_malloc
+#define free mm_free
+#define realloc mm_realloc
+#define calloc mm_calloc
+#endif /* def DRIVER */
+
+#if defined(__x86_64__) && defined(RSEQ_SIG)
+#define HAVE_RSEQ
+#endif
+
+/* Cache geometry */
+#define MT_MAXSLOTS 64           /* Most free blocks of a class in a cache */
+#define MT_MINSLOTS 4            /* Fewest, for the largest classes */
+#define MT_CLASS_BYTES (1 << 14) /* Payload bytes of a class in a cache */
+#define MT_DEPOT_MAX 64          /* Most batches of a class in the depot */
+#define MT_ALIGN 8               /* Alignment of every mm payload */
+
+#define MIN(x, y) ((x) < (y) ? (x) : (y))
+
+/* A cache of free blocks, per CPU or per thread */
+typedef struct mt_cache {
+  struct mt_cache *next;                 /* Next thread cache */
+  unsigned int n[SC_NCLASSES];           /* Free blocks of each class */
+  void *slots[SC_NCLASSES][MT_MAXSLOTS]; /* The blocks, n[c] of them */
+} mt_cache_t;
+
+/* Batch links in the first bytes of each free block of a batch */
+#define BATCH_NEXT(bp) (*(void **)(bp))                 /* Next block */
+#define BATCH_BELOW(bp) (*(uint32_t *)((char *)(bp) + 8)) /* Batch below */
+
+/* Tagged depot stack top: offset of the top batch in the low half */
+#define TOP(off, tag) (((uint64_t)(tag) << 32) | (off))
+#define TOP_OFF(top) ((uint32_t)(top))
+#define TOP_TAG(top) ((uint32_t)((top) >> 32))
+#define OFF(bp) ((uint32_t)((char *)(bp)-mt_base))
+#define OFFP(off) ((void *)(mt_base + (off)))
+
+/* The depot of one class, on a cache line of its own */
+typedef struct mt_depot {
+  uint64_t top;         /* Tagged top batch, offset 0 if empty */
+  unsigned int batches; /* Batches in the stack, roughly */
+} __attribute__((aligned(64))) mt_depot_t;
+
+/* Global variables */
+static pthread_mutex_t mt_lock = PTHREAD_MUTEX_INITIALIZER; /* Guards mm */
+static int mt_mode;                      /* MM_MT_PERCPU or MM_MT_PERTHREAD */
+static unsigned int mt_cap[SC_NCLASSES]; /* Slots used for each class */
+/* Class serving each class; refills change it while other threads read
+ * it without the lock, so it is only accessed atomically */
+static unsigned int mt_home[SC_NCLASSES];
+static mt_cache_t *mt_cpus;              /* Per-CPU caches */
+static unsigned int mt_ncpus;            /* Number of per-CPU caches */
+static mt_cache_t *mt_threads;           /* List of thread caches */
+static pthread_key_t mt_key;             /* Hands a thread cache back */
+static int mt_key_made;
+static int mt_fork_made;                 /* Fork handlers registered */
+static __thread mt_cache_t *mt_tcache;   /* Cache of this thread */
+static mt_depot_t mt_depot[SC_NCLASSES]; /* Central batches of each class */
+static char *mt_base;                    /* Depot offsets are from here */
+static size_t mt_locks;                  /* Times the mm heap was locked */
+
+/* Function prototypes for internal helper routines */
+static void heap_lock(void);
+static unsigned int block_class(size_t usable);
+static void *cache_pop(unsigned int cls);
+static int cache_push(void *bp, unsigned int cls);
+static void *refill(unsigned int cls);
+static void drain(void *bp, unsigned int cls);
+static void *depot_pop(unsigned int cls);
+static int depot_push(void *batch, unsigned int cls);
+static mt_cache_t *thread_cache(void);
+static void thread_exit(void *arg);
+static int rseq_usable(void);
+static void fork_prepare(void);
+static void fork_parent(void);
+static void fork_child(void);
+
+/* The class serving class cls */
+static inline unsigned int home_of(unsigned int cls) {
+  return __atomic_load_n(&mt_home[cls], __ATOMIC_RELAXED);
+}
+
+/*
+ * mm_mt_init - Reset the mm heap and set up the caches for mode. Must be
+ *              called before any other thread uses the allocator. Return
+ *              the mode in use, or -1 on error.
+ */
+int mm_mt_init(int mode) {
+  unsigned int cls, i;
+  /* before the heap is reset, as sysconf may allocate when preloaded */
+  long ncpus = sysconf(_SC_NPROCESSORS_CONF);
+
+  if (!mt_key_made) {
+    if (pthread_key_create(&mt_key, thread_exit) != 0)
+      return -1;
+    mt_key_made = 1;
+  }
+  /* caches of an earlier run lived in the heap that is reset here */
+  pthread_setspecific(mt_key, NULL);
+  mt_tcache = NULL;
+  mt_threads = NULL;
+  mt_cpus = NULL;
+  mt_ncpus = 0;
+  if (mm_init() < 0)
+    return -1;
+  /* after mm_init, as pthread_atfork may allocate when preloaded */
+  if (!mt_fork_made) {
+    if (pthread_atfork(fork_prepare, fork_parent, fork_child) != 0)
+      return -1;
+    mt_fork_made = 1;
+  }
+  mt_base = mem_heap_lo();
+  mt_locks = 0;
+  memset(mt_depot, 0, sizeof(mt_depot));
+
+  for (cls = 0; cls < SC_NCLASSES; cls++) {
+    __atomic_store_n(&mt_home[cls], cls, __ATOMIC_RELAXED);
+    mt_cap[cls] = MT_CLASS_BYTES / sc_size[cls];
+    if (mt_cap[cls] < MT_MINSLOTS)
+      mt_cap[cls] = MT_MINSLOTS;
+    if (mt_cap[cls] > MT_MAXSLOTS)
+      mt_cap[cls] = MT_MAXSLOTS;
+  }
+
+  if (mode == MM_MT_PERCPU && rseq_usable()) {
+    mt_ncpus = ncpus;
+    mt_cpus = malloc(mt_ncpus * sizeof(mt_cache_t));
+    if (mt_cpus == NULL)
+      return -1;
+    for (i = 0; i < mt_ncpus; i++)
+      memset(mt_cpus[i].n, 0, sizeof(mt_cpus[i].n));
+  } else {
+    mode = MM_MT_PERTHREAD;
+  }
+  mt_mode = mode;
+  return mode;
+}
+
+/*
+ * mm_mt_malloc - Allocate a block with at least size bytes of payload
+ */
+void *mm_mt_malloc(size_t size) {
+  unsigned int cls;
+  void *bp;
+
+  if (size == 0)
+    return NULL;
+  if (size > SC_MAXSIZE) {
+    heap_lock();
+    bp = malloc(size);
+    pthread_mutex_unlock(&mt_lock);
+    return bp;
+  }
+  cls = sc_class(size);
+  if ((bp = cache_pop(home_of(cls))) != NULL)
+    return bp;
+  return refill(cls);
+}
+
+/*
+ * mm_mt_free - Free a block, into a cache if it fits a size class
+ */
+void mm_mt_free(void *bp) {
+  size_t usable;
+  unsigned int cls;
+
+  if (bp == NULL)
+    return;
+  usable = mm_usable_size(bp);
+  if (usable < sc_size[0] || usable > SC_MAXSIZE) {
+    heap_lock();
+    free(bp);
+    pthread_mutex_unlock(&mt_lock);
+    return;
+  }
+  cls = block_class(usable);
+  if (cache_push(bp, cls) < 0)
+    drain(bp, cls);
+}
+
+/*
+ * mm_mt_free_sized - Free a block allocated with size bytes, straight into
+ *                    the cache of its class without reading its header
+ */
+void mm_mt_free_sized(void *bp, size_t size) {
+  unsigned int cls;
+
+  if (bp == NULL)
+    return;
+  if (size == 0 || size > SC_MAXSIZE) {
+    mm_mt_free(bp);
+    return;
+  }
+  /* a class served by a larger one has no blocks of its own */
+  cls = sc_class(size);
+  if (home_of(cls) != cls) {
+    mm_mt_free(bp);
+    return;
+  }
+  if (cache_push(bp, cls) < 0)
+    drain(bp, cls);
+}
+
+/*
+ * mm_mt_memalign - Allocate a block whose payload is aligned to align, a
+ *                  power of two
+ */
+void *mm_mt_memalign(size_t align, size_t size) {
+  void *bp;
+
+  if (align <= MT_ALIGN)
+    return mm_mt_malloc(size);
+  heap_lock();
+  bp = mm_memalign(align, size);
+  pthread_mutex_unlock(&mt_lock);
+  return bp;
+}
+
+/*
+ * mm_mt_realloc - Resize a block, moving it if it has to grow
+ */
+void *mm_mt_realloc(void *ptr, size_t size) {
+  size_t oldsize;
+  void *newptr;
+
+  if (ptr == NULL)
+    return mm_mt_malloc(size);
+  if (size == 0) {
+    mm_mt_free(ptr);
+    return NULL;
+  }
+  oldsize = mm_usable_size(ptr);
+  if (size <= oldsize)
+    return ptr;
+  if ((newptr = mm_mt_malloc(size)) == NULL)
+    return NULL;
+  memcpy(newptr, ptr, MIN(oldsize, size));
+  mm_mt_free(ptr);
+  return newptr;
+}
+
+/*
+ * mm_mt_stats - Report how much memory the caches hold
+ */
+void mm_mt_stats(mm_mt_stats_t *st) {
+  mt_cache_t *cache;
+  unsigned int i, cls;
+
+  pthread_mutex_lock(&mt_lock);
+  st->mode = mt_mode;
+  st->heap_locks = mt_locks;
+  st->caches = 0;
+  st->cached_bytes = 0;
+  st->depot_bytes = 0;
+  for (i = 0; i < mt_ncpus; i++, st->caches++)
+    for (cls = 0; cls < SC_NCLASSES; cls++)
+      st->cached_bytes += (size_t)mt_cpus[i].n[cls] * sc_size[cls];
+  for (cache = mt_threads; cache; cache = cache->next, st->caches++)
+    for (cls = 0; cls < SC_NCLASSES; cls++)
+      st->cached_bytes += (size_t)cache->n[cls] * sc_size[cls];
+  for (cls = 0; cls < SC_NCLASSES; cls++)
+    st->depot_bytes += (size_t)__atomic_load_n(&mt_depot[cls].batches,
+                                                __ATOMIC_RELAXED) *
+                       (mt_cap[cls] / 2) * sc_size[cls];
+  st->meta_bytes = st->caches * sizeof(mt_cache_t);
+  st->heap_bytes = mem_heapsize();
+  pthread_mutex_unlock(&mt_lock);
+}
+
+/*
+ * The remaining routines are internal helper routines
+ */
+
+#ifdef HAVE_RSEQ
+/* The rseq area glibc registered for this thread */
+#define RSEQ_AREA()                                                            \
+  ((volatile struct rseq *)((char *)__builtin_thread_pointer() + __rseq_offset))
+
+/*
+ * The critical section runs from label 1 to label 2, whose last
+ * instruction is the commit; label 3 is its descriptor and label 4 the
+ * abort handler, which must follow the signature the kernel checks.
+ */
+#define RSEQ_CS_START                                                          \
+  ".pushsection __rseq_cs, \"aw\"\n\t"                                         \
+  ".balign 32\n\t"                                                             \
+  "3: .long 0, 0\n\t"                                                          \
+  ".quad 1f, 2f - 1f, 4f\n\t"                                                  \
+  ".popsection\n\t"                                                            \
+  "leaq 3b(%%rip), %%rax\n\t"                                                  \
+  "movq %%rax, %%fs:%c[rseq_cs](%[rseq_off])\n\t"                              \
+  "1:\n\t"                                                                     \
+  "cmpl %[cpu], %%fs:%c[cpu_id](%[rseq_off])\n\t"                              \
+  "jnz 4f\n\t"
+
+#define RSEQ_CS_END                                                            \
+  "2:\n\t"                                                                     \
+  ".pushsection __rseq_failure, \"ax\"\n\t"                                    \
+  ".long %c[sig]\n\t"                                                          \
+  "4: jmp %l[restart]\n\t"                                                     \
+  ".popsection\n\t"
+
+#define RSEQ_OPERANDS                                                          \
+  [rseq_off] "r"(__rseq_offset), [cpu] "r"(cpu),                               \
+      [rseq_cs] "i"(offsetof(struct rseq, rseq_cs)),                           \
+      [cpu_id] "i"(offsetof(struct rseq, cpu_id)), [sig] "i"(RSEQ_SIG)
+
+/*
+ * cpu_pop - Pop a free block of class cls from the cache of the CPU the
+ *           thread runs on, return NULL if it has none
+ */
+static void *cpu_pop(unsigned int cls) {
+  unsigned int cpu;
+  void *bp;
+
+restart:
+  cpu = RSEQ_AREA()->cpu_id_start;
+  if (cpu >= mt_ncpus)
+    return NULL;
+  __asm__ goto(RSEQ_CS_START
+               "movl (%[n]), %%eax\n\t"
+               "testl %%eax, %%eax\n\t"
+               "jz %l[empty]\n\t"
+               "movq -8(%[slots], %%rax, 8), %%rcx\n\t"
+               "movq %%rcx, (%[bp])\n\t"
+               "decl %%eax\n\t"
+               "movl %%eax, (%[n])\n\t" /* commit */
+               RSEQ_CS_END
+               :
+               : RSEQ_OPERANDS, [n] "r"(&mt_cpus[cpu].n[cls]),
+                 [slots] "r"(mt_cpus[cpu].slots[cls]), [bp] "r"(&bp)
+               : "rax", "rcx", "memory", "cc"
+               : restart, empty);
+  return bp;
+empty:
+  return NULL;
+}
+
+/*
+ * cpu_push - Push the free block bp of class cls on the cache of the CPU
+ *            the thread runs on, return -1 if it is full
+ */
+static int cpu_push(void *bp, unsigned int cls) {
+  unsigned int cpu;
+
+restart:
+  cpu = RSEQ_AREA()->cpu_id_start;
+  if (cpu >= mt_ncpus)
+    return -1;
+  __asm__ goto(RSEQ_CS_START
+               "movl (%[n]), %%eax\n\t"
+               "cmpl %[cap], %%eax\n\t"
+               "jae %l[full]\n\t"
+               "movq %[bp], (%[slots], %%rax, 8)\n\t"
+               "incl %%eax\n\t"
+               "movl %%eax, (%[n])\n\t" /* commit */
+               RSEQ_CS_END
+               :
+               : RSEQ_OPERANDS, [n] "r"(&mt_cpus[cpu].n[cls]),
+                 [slots] "r"(mt_cpus[cpu].slots[cls]), [bp] "r"(bp),
+                 [cap] "r"(mt_cap[cls])
+               : "rax", "memory", "cc"
+               : restart, full);
+  return 0;
+full:
+  return -1;
+}
+
+/*
+ * rseq_usable - Whether glibc registered rseq for this thread, and so
+ *               for every thread
+ */
+static int rseq_usable(void) {
+  return __rseq_size > 0 && (int)RSEQ_AREA()->cpu_id >= 0;
+}
+#else
+static void *cpu_pop(unsigned int cls) { return NULL; }
+static int cpu_push(void *bp, unsigned int cls) { return -1; }
+static int rseq_usable(void) { return 0; }
+#endif /* def HAVE_RSEQ */
+
+/*
+ * heap_lock - Take the mm heap mutex, counting how often
+ */
+static void heap_lock(void) {
+  pthread_mutex_lock(&mt_lock);
+  mt_locks++;
+}
+
+/*
+ * fork_prepare - Hold the mm heap across a fork
+ */
+static void fork_prepare(void) { pthread_mutex_lock(&mt_lock); }
+
+/*
+ * fork_parent - Let go of the mm heap after a fork
+ */
+static void fork_parent(void) { pthread_mutex_unlock(&mt_lock); }
+
+/*
+ * fork_child - Let go of the mm heap in the child, keeping only the
+ *              cache of the thread that forked. The blocks in the caches
+ *              of the others are lost to the child, as those threads
+ *              may have been halfway through a push or pop.
+ */
+static void fork_child(void) {
+  mt_threads = mt_tcache;
+  if (mt_tcache != NULL)
+    mt_tcache->next = NULL;
+  pthread_mutex_unlock(&mt_lock);
+}
+
+/*
+ * block_class - The largest class a block of usable payload bytes can
+ *               serve
+ */
+static unsigned int block_class(size_t usable) {
+  unsigned int cls = sc_class(usable);
+  if (sc_size[cls] > usable)
+    cls--;
+  return cls;
+}
+
+/*
+ * cache_pop - Pop a free block of class cls from the cache of this CPU or
+ *             thread, return NULL if it has none
+ */
+static void *cache_pop(unsigned int cls) {
+  mt_cache_t *tc;
+
+  if (mt_mode == MM_MT_PERCPU)
+    return cpu_pop(cls);
+  if ((tc = thread_cache()) == NULL || tc->n[cls] == 0)
+    return NULL;
+  return tc->slots[cls][--tc->n[cls]];
+}
+
+/*
+ * cache_push - Push a free block of class cls on the cache of this CPU or
+ *              thread, return -1 if it is full
+ */
+static int cache_push(void *bp, unsigned int cls) {
+  mt_cache_t *tc;
+
+  if (mt_mode == MM_MT_PERCPU)
+    return cpu_push(bp, cls);
+  if ((tc = thread_cache()) == NULL || tc->n[cls] == mt_cap[cls])
+    return -1;
+  tc->slots[cls][tc->n[cls]++] = bp;
+  return 0;
+}
+
+/*
+ * refill - Take a batch of blocks for class cls from the depot, or
+ *          allocate half a cache worth from mm if it is dry; return one
+ *          block and cache the rest.
+ *          When mm rounds the blocks up (line alignment, page spans) they
+ *          are freed into a larger class, which then serves cls as well.
+ */
+static void *refill(unsigned int cls) {
+  void *bp, *next, *batch;
+  unsigned int i, n, home = home_of(cls);
+  size_t usable;
+
+  if ((batch = depot_pop(home)) == NULL) {
+    n = mt_cap[home] / 2;
+    heap_lock();
+    for (i = 0; i < n; i++) {
+      if ((bp = malloc(sc_size[home])) == NULL)
+        break;
+      BATCH_NEXT(bp) = batch;
+      batch = bp;
+    }
+    pthread_mutex_unlock(&mt_lock);
+    if (batch == NULL)
+      return NULL;
+    usable = mm_usable_size(batch);
+    if (usable <= SC_MAXSIZE && block_class(usable) != home) {
+      /* the larger class takes over cls and the class that served it */
+      __atomic_store_n(&mt_home[home], block_class(usable), __ATOMIC_RELAXED);
+      home = block_class(usable);
+      __atomic_store_n(&mt_home[cls], home, __ATOMIC_RELAXED);
+    }
+  }
+  cls = home;
+  bp = batch;
+  batch = BATCH_NEXT(bp);
+  /* another thread on this CPU may have filled the cache meanwhile */
+  for (; batch != NULL; batch = next) {
+    next = BATCH_NEXT(batch);
+    if (cache_push(batch, cls) < 0)
+      break;
+  }
+  if (batch != NULL && depot_push(batch, cls) < 0) {
+    heap_lock();
+    for (; batch != NULL; batch = next) {
+      next = BATCH_NEXT(batch);
+      free(batch);
+    }
+    pthread_mutex_unlock(&mt_lock);
+  }
+  return bp;
+}
+
+/*
+ * drain - Hand bp and half a cache worth of class cls blocks to the
+ *         depot, or free them to mm if the depot is full
+ */
+static void drain(void *bp, unsigned int cls) {
+  void *batch = bp, *next;
+  unsigned int n, max = mt_cap[cls] / 2;
+
+  BATCH_NEXT(bp) = NULL;
+  for (n = 1; n < max; n++) {
+    if ((bp = cache_pop(cls)) == NULL)
+      break;
+    BATCH_NEXT(bp) = batch;
+    batch = bp;
+  }
+  if (depot_push(batch, cls) == 0)
+    return;
+  heap_lock();
+  for (; batch != NULL; batch = next) {
+    next = BATCH_NEXT(batch);
+    free(batch);
+  }
+  pthread_mutex_unlock(&mt_lock);
+}
+
+/*
+ * depot_pop - Pop the top batch of class cls, NULL if there is none
+ */
+static void *depot_pop(unsigned int cls) {
+  mt_depot_t *d = &mt_depot[cls];
+  uint64_t top, below;
+  void *batch;
+
+  top = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+  do {
+    if (TOP_OFF(top) == 0)
+      return NULL;
+    batch = OFFP(TOP_OFF(top));
+    /* batch may be popped and reused under us; the heap stays mapped, so
+     * this read is safe, and the tag makes the exchange fail if so */
+    below = __atomic_load_n(&BATCH_BELOW(batch), __ATOMIC_RELAXED);
+  } while (!__atomic_compare_exchange_n(&d->top, &top,
+                                        TOP(below, TOP_TAG(top) + 1), 1,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE));
+  __atomic_fetch_sub(&d->batches, 1, __ATOMIC_RELAXED);
+  return batch;
+}
+
+/*
+ * depot_push - Push a batch of class cls, return -1 if the depot already
+ *              holds MT_DEPOT_MAX batches
+ */
+static int depot_push(void *batch, unsigned int cls) {
+  mt_depot_t *d = &mt_depot[cls];
+  uint64_t top;
+
+  if (__atomic_fetch_add(&d->batches, 1, __ATOMIC_RELAXED) >= MT_DEPOT_MAX) {
+    __atomic_fetch_sub(&d->batches, 1, __ATOMIC_RELAXED);
+    return -1;
+  }
+  top = __atomic_load_n(&d->top, __ATOMIC_RELAXED);
+  do {
+    __atomic_store_n(&BATCH_BELOW(batch), TOP_OFF(top), __ATOMIC_RELAXED);
+  } while (!__atomic_compare_exchange_n(&d->top, &top,
+                                        TOP(OFF(batch), TOP_TAG(top) + 1), 1,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+  return 0;
+}
+
+/*
+ * thread_cache - The cache of this thread, made on first use; NULL if
+ *                mm is out of memory
+ */
+static mt_cache_t *thread_cache(void) {
+  mt_cache_t *tc = mt_tcache;
+
+  if (tc != NULL)
+    return tc;
+  heap_lock();
+  if ((tc = malloc(sizeof(mt_cache_t))) != NULL) {
+    memset(tc->n, 0, sizeof(tc->n));
+    tc->next = mt_threads;
+    mt_threads = tc;
+  }
+  pthread_mutex_unlock(&mt_lock);
+  if (tc != NULL) {
+    mt_tcache = tc;
+    pthread_setspecific(mt_key, tc);
+  }
+  return tc;
+}
+
+/*
+ * thread_exit - Hand the cache of an exiting thread and its blocks back
+ */
+static void thread_exit(void *arg) {
+  mt_cache_t *tc = arg, **pp;
+  unsigned int cls, i;
+
+  heap_lock();
+  for (cls = 0; cls < SC_NCLASSES; cls++)
+    for (i = 0; i < tc->n[cls]; i++)
+      free(tc->slots[cls][i]);
+  for (pp = &mt_threads; *pp; pp = &(*pp)->next)
+    if (*pp == tc) {
+      *pp = tc->next;
+      break;
+    }
+  free(tc);
+  pthread_mutex_unlock(&mt_lock);
+  mt_tcache = NULL;
+}
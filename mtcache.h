@@ -0,0 +1,30 @@
+/*
+ * mtcache.h - thread-safe front end with per-CPU or per-thread caches
+ *             over the mm heap
+ */
+#include <stddef.h>
+
+/* Cache modes for mm_mt_init */
+#define MM_MT_PERCPU 0    /* One cache per CPU, updated with rseq */
+#define MM_MT_PERTHREAD 1 /* One cache per thread */
+
+typedef struct mm_mt_stats {
+  int mode;            /* Mode in use */
+  size_t caches;       /* Caches in existence */
+  size_t cached_bytes; /* Payload bytes of the free blocks held in caches */
+  size_t depot_bytes;  /* Payload bytes in the depot, estimated */
+  size_t meta_bytes;   /* Bytes taken by the caches themselves */
+  size_t heap_bytes;   /* Size of the mm heap */
+  size_t heap_locks;   /* Times the mm heap was locked */
+} mm_mt_stats_t;
+
+/* Reset the mm heap and start caching in mode; return the mode in use,
+ * MM_MT_PERTHREAD if MM_MT_PERCPU was asked for but rseq is missing */
+extern int mm_mt_init(int mode);
+extern void *mm_mt_malloc(size_t size);
+extern void mm_mt_free(void *ptr);
+/* Free a block allocated with size bytes, skipping the header lookup */
+extern void mm_mt_free_sized(void *ptr, size_t size);
+extern void *mm_mt_memalign(size_t align, size_t size);
+extern void *mm_mt_realloc(void *ptr, size_t size);
+extern void mm_mt_stats(mm_mt_stats_t *st);
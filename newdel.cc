@@ -0,0 +1,125 @@
+/*
+ * newdel.cc
+ * the global operator new and delete over mtcache, part of libmm.so (see
+ * preload.c):
+ * 1) new goes through malloc, or aligned_alloc for the align_val_t forms,
+ *    of preload.c, so the heap is set up by whichever comes first. On
+ *    failure the new handler runs and the allocation is retried, and the
+ *    nothrow forms return nullptr where the others throw bad_alloc;
+ * 2) the sized forms of delete pass the size on to mm_mt_free_sized, which
+ *    puts the block into the cache of its class without reading its
+ *    header. An aligned block may not be the size of its class, so the
+ *    align_val_t forms of delete ignore the size;
+ * 3) no form of new hands out less than 8-byte alignment, and
+ *    std::align_val_t asks for more when a type needs it.
+ */
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+extern "C" {
+#include "mtcache.h"
+}
+
+namespace {
+
+/*
+ * alloc - Allocate size bytes aligned to align, running the new handler
+ *         until that succeeds; return nullptr if there is none
+ */
+void *alloc(std::size_t size, std::size_t align) {
+  void *bp;
+
+  for (;;) {
+    bp = align ? std::aligned_alloc(align, size) : std::malloc(size);
+    if (bp != nullptr)
+      return bp;
+    std::new_handler handler = std::get_new_handler();
+    if (handler == nullptr)
+      return nullptr;
+    handler();
+  }
+}
+
+/*
+ * alloc_or_throw - alloc, throwing bad_alloc on failure
+ */
+void *alloc_or_throw(std::size_t size, std::size_t align) {
+  void *bp = alloc(size, align);
+  if (bp == nullptr)
+    throw std::bad_alloc();
+  return bp;
+}
+
+/*
+ * alloc_nothrow - alloc, returning nullptr also if the new handler throws
+ */
+void *alloc_nothrow(std::size_t size, std::size_t align) noexcept {
+  try {
+    return alloc(size, align);
+  } catch (...) {
+    return nullptr;
+  }
+}
+
+} // namespace
+
+/* Plain forms */
+void *operator new(std::size_t size) { return alloc_or_throw(size, 0); }
+void *operator new[](std::size_t size) { return alloc_or_throw(size, 0); }
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+  return alloc_nothrow(size, 0);
+}
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+  return alloc_nothrow(size, 0);
+}
+
+void operator delete(void *ptr) noexcept { mm_mt_free(ptr); }
+void operator delete[](void *ptr) noexcept { mm_mt_free(ptr); }
+void operator delete(void *ptr, const std::nothrow_t &) noexcept {
+  mm_mt_free(ptr);
+}
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept {
+  mm_mt_free(ptr);
+}
+void operator delete(void *ptr, std::size_t size) noexcept {
+  mm_mt_free_sized(ptr, size);
+}
+void operator delete[](void *ptr, std::size_t size) noexcept {
+  mm_mt_free_sized(ptr, size);
+}
+
+/* Aligned forms */
+void *operator new(std::size_t size, std::align_val_t align) {
+  return alloc_or_throw(size, static_cast<std::size_t>(align));
+}
+void *operator new[](std::size_t size, std::align_val_t align) {
+  return alloc_or_throw(size, static_cast<std::size_t>(align));
+}
+void *operator new(std::size_t size, std::align_val_t align,
+                   const std::nothrow_t &) noexcept {
+  return alloc_nothrow(size, static_cast<std::size_t>(align));
+}
+void *operator new[](std::size_t size, std::align_val_t align,
+                     const std::nothrow_t &) noexcept {
+  return alloc_nothrow(size, static_cast<std::size_t>(align));
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept { mm_mt_free(ptr); }
+void operator delete[](void *ptr, std::align_val_t) noexcept {
+  mm_mt_free(ptr);
+}
+void operator delete(void *ptr, std::align_val_t,
+                     const std::nothrow_t &) noexcept {
+  mm_mt_free(ptr);
+}
+void operator delete[](void *ptr, std::align_val_t,
+                       const std::nothrow_t &) noexcept {
+  mm_mt_free(ptr);
+}
+void operator delete(void *ptr, std::size_t, std::align_val_t) noexcept {
+  mm_mt_free(ptr);
+}
+void operator delete[](void *ptr, std::size_t, std::align_val_t) noexcept {
+  mm_mt_free(ptr);
+}
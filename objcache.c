@@ -0,0 +1,228 @@
+/*
+ * objcache.c
+ * caches of constructed objects on top of the mm heap:
+ * 1) a cache hands out objects of one size from slabs, each slab a single
+ *    mm block aligned to its own size, so the slab of an object is found
+ *    by masking the object's address;
+ * 2) every object of a slab is constructed once, when the slab is made,
+ *    and destructed once, when the slab goes back to mm. In between a
+ *    freed object keeps its constructed state: the free slots of a slab
+ *    are kept as a stack of indices in the slab header, not as links in
+ *    the objects themselves;
+ * 3) objects come from the partial slabs first, then from the empty
+ *    ones, and only then from a new slab. Empty slabs stay with the cache
+ *    until mm_cache_reap or mm_cache_destroy, which a reclaim callback of
+ *    the soft limit (see mm.c) can call.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "mm.h"
+#include "objcache.h"
+
+#define ALIGNMENT 8
+#define ALIGN_TO(p, a) (((size_t)(p) + ((a)-1)) & ~((size_t)(a)-1))
+
+#define SLAB_MINSIZE (1 << 14) /* Smallest slab (bytes) */
+#define SLAB_MINOBJS 8         /* A slab holds at least this many objects */
+#define SLAB_MAXOBJS 65535     /* and at most this many */
+
+/* A slab header, the objects follow it */
+typedef struct slab {
+  struct slab *next, *prev; /* Full, partial or empty list it is on */
+  unsigned int nfree;       /* Free slots */
+  unsigned short free[];    /* Stack of the indices of those slots */
+} slab_t;
+
+struct mm_cache {
+  char name[MM_CACHE_NAMELEN];
+  size_t size;              /* Object size asked for */
+  size_t stride;            /* Distance between two objects */
+  size_t offset;            /* Offset of the first object in a slab */
+  size_t slabsize;          /* Bytes of a slab, a power of two */
+  unsigned int perslab;     /* Objects per slab */
+  void (*ctor)(void *);     /* Run on every object of a new slab */
+  void (*dtor)(void *);     /* Run on every object of a dropped slab */
+  slab_t *full;             /* Slabs with every object in use */
+  slab_t *partial;          /* Slabs with objects in use and free ones */
+  slab_t *empty;            /* Slabs with no object in use */
+};
+
+/* The slab of object obj, and object number i of slab s */
+#define SLAB_OF(cache, obj)                                                    \
+  ((slab_t *)((size_t)(obj) & ~((cache)->slabsize - 1)))
+#define SLAB_OBJ(cache, s, i)                                                  \
+  ((char *)(s) + (cache)->offset + (i) * (cache)->stride)
+
+/*
+ * fit - Objects of cache a slab of slabsize bytes holds, setting the
+ *       offset of the first one
+ */
+static unsigned int fit(mm_cache_t *cache, size_t slabsize, size_t align) {
+  size_t n = (slabsize - sizeof(slab_t)) / (cache->stride + sizeof(short));
+
+  if (n > SLAB_MAXOBJS)
+    n = SLAB_MAXOBJS;
+  while (n > 0 && ALIGN_TO(sizeof(slab_t) + n * sizeof(short), align) +
+                          n * cache->stride > slabsize)
+    n--;
+  cache->offset = ALIGN_TO(sizeof(slab_t) + n * sizeof(short), align);
+  return n;
+}
+
+/*
+ * mm_cache_create - Create an empty cache, return NULL on error
+ */
+mm_cache_t *mm_cache_create(const char *name, size_t size, size_t align,
+                            void (*ctor)(void *), void (*dtor)(void *)) {
+  mm_cache_t *cache;
+  size_t slabsize = SLAB_MINSIZE;
+
+  if (align == 0)
+    align = ALIGNMENT;
+  if (size == 0 || (align & (align - 1)))
+    return NULL;
+  if ((cache = mm_malloc(sizeof(mm_cache_t))) == NULL)
+    return NULL;
+  snprintf(cache->name, sizeof(cache->name), "%s", name ? name : "");
+  cache->size = size;
+  cache->stride = ALIGN_TO(size, align < ALIGNMENT ? ALIGNMENT : align);
+  while ((cache->perslab = fit(cache, slabsize, align)) < SLAB_MINOBJS)
+    slabsize <<= 1;
+  cache->slabsize = slabsize;
+  cache->ctor = ctor;
+  cache->dtor = dtor;
+  cache->full = cache->partial = cache->empty = NULL;
+  return cache;
+}
+
+/*
+ * slab_push - Put slab s on the front of list
+ */
+static void slab_push(slab_t **list, slab_t *s) {
+  s->prev = NULL;
+  s->next = *list;
+  if (*list)
+    (*list)->prev = s;
+  *list = s;
+}
+
+/*
+ * slab_unlink - Take slab s off list
+ */
+static void slab_unlink(slab_t **list, slab_t *s) {
+  if (s->prev)
+    s->prev->next = s->next;
+  else
+    *list = s->next;
+  if (s->next)
+    s->next->prev = s->prev;
+}
+
+/*
+ * slab_create - A new slab with every object constructed, NULL on error
+ */
+static slab_t *slab_create(mm_cache_t *cache) {
+  slab_t *s;
+  unsigned int i;
+
+  if ((s = mm_memalign(cache->slabsize, cache->slabsize)) == NULL)
+    return NULL;
+  s->nfree = cache->perslab;
+  /* hand the slots out in address order */
+  for (i = 0; i < cache->perslab; i++) {
+    s->free[i] = cache->perslab - 1 - i;
+    if (cache->ctor)
+      cache->ctor(SLAB_OBJ(cache, s, i));
+  }
+  return s;
+}
+
+/*
+ * slab_destroy - Destruct every object of slab s and give it back to mm
+ */
+static void slab_destroy(mm_cache_t *cache, slab_t *s) {
+  unsigned int i;
+
+  if (cache->dtor)
+    for (i = 0; i < cache->perslab; i++)
+      cache->dtor(SLAB_OBJ(cache, s, i));
+  mm_free(s);
+}
+
+/*
+ * mm_cache_alloc - Pop a free object of a partial slab, moving an empty
+ *                  or new slab to the partial list when there is none and
+ *                  a slab that runs out to the full list
+ */
+void *mm_cache_alloc(mm_cache_t *cache) {
+  slab_t *s = cache->partial;
+
+  if (s == NULL) {
+    if ((s = cache->empty) != NULL)
+      slab_unlink(&cache->empty, s);
+    else if ((s = slab_create(cache)) == NULL)
+      return NULL;
+    slab_push(&cache->partial, s);
+  }
+  if (--s->nfree == 0) {
+    slab_unlink(&cache->partial, s);
+    slab_push(&cache->full, s);
+  }
+  return SLAB_OBJ(cache, s, s->free[s->nfree]);
+}
+
+/*
+ * mm_cache_free - Push obj back on the free stack of its slab
+ */
+void mm_cache_free(mm_cache_t *cache, void *obj) {
+  slab_t *s;
+
+  if (obj == NULL)
+    return;
+  s = SLAB_OF(cache, obj);
+  s->free[s->nfree++] =
+      (unsigned short)(((char *)obj - SLAB_OBJ(cache, s, 0)) / cache->stride);
+  if (s->nfree == 1) {
+    slab_unlink(&cache->full, s);
+    slab_push(&cache->partial, s);
+  }
+  if (s->nfree == cache->perslab) {
+    slab_unlink(&cache->partial, s);
+    slab_push(&cache->empty, s);
+  }
+}
+
+/*
+ * mm_cache_reap - Destroy the empty slabs of cache
+ */
+size_t mm_cache_reap(mm_cache_t *cache) {
+  size_t bytes = 0;
+  slab_t *s;
+
+  while ((s = cache->empty) != NULL) {
+    cache->empty = s->next;
+    slab_destroy(cache, s);
+    bytes += cache->slabsize;
+  }
+  return bytes;
+}
+
+/*
+ * mm_cache_destroy - Give every slab and the cache itself back to mm
+ */
+void mm_cache_destroy(mm_cache_t *cache) {
+  slab_t *s;
+
+  mm_cache_reap(cache);
+  while ((s = cache->partial) != NULL || (s = cache->full) != NULL) {
+    slab_unlink(s == cache->partial ? &cache->partial : &cache->full, s);
+    slab_destroy(cache, s);
+  }
+  mm_free(cache);
+}
+
+/*
+ * mm_cache_name - The name the cache was created with
+ */
+const char *mm_cache_name(mm_cache_t *cache) { return cache->name; }
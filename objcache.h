@@ -0,0 +1,26 @@
+/*
+ * objcache.h - caches of constructed objects in slabs carved from the mm
+ *              heap, after the kmem_cache of Solaris
+ */
+#include <stddef.h>
+
+typedef struct mm_cache mm_cache_t;
+
+/* Longest cache name kept, the rest is cut off */
+#define MM_CACHE_NAMELEN 32
+
+/* Create a cache of objects of size bytes aligned to align (0: 8), a power
+ * of two. ctor, if not NULL, is run once on every object when its slab is
+ * made, dtor when the slab is given back. Return NULL on error. */
+extern mm_cache_t *mm_cache_create(const char *name, size_t size,
+                                   size_t align, void (*ctor)(void *),
+                                   void (*dtor)(void *));
+/* An object in its constructed state, NULL if the heap is full */
+extern void *mm_cache_alloc(mm_cache_t *cache);
+/* Take obj back; it must be in its constructed state again */
+extern void mm_cache_free(mm_cache_t *cache, void *obj);
+/* Give the slabs with no object in use back to mm; return their bytes */
+extern size_t mm_cache_reap(mm_cache_t *cache);
+/* Give every slab back, objects still in use included */
+extern void mm_cache_destroy(mm_cache_t *cache);
+extern const char *mm_cache_name(mm_cache_t *cache);
@@ -0,0 +1,68 @@
+/*
+ * perfctr.c - Count hardware events (data TLB misses) around a piece of
+ *     code with the Linux perf_event_open interface.
+ *
+ * The counters only see user-level events of the calling thread, which
+ * works with the default perf_event_paranoid setting. Virtual machines
+ * often do not expose the PMU; perfctr_open_dtlb returns -1 then.
+ */
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "perfctr.h"
+
+/*
+ * perfctr_open_dtlb - Open a disabled counter of data TLB load misses
+ */
+int perfctr_open_dtlb(void)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB |
+	(PERF_COUNT_HW_CACHE_OP_READ << 8) |
+	(PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/*
+ * perfctr_start - Zero the counter and start counting
+ */
+void perfctr_start(int fd)
+{
+    if (fd < 0)
+	return;
+    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+}
+
+/*
+ * perfctr_stop - Stop counting and return the number of events seen
+ */
+long long perfctr_stop(int fd)
+{
+    long long count;
+
+    if (fd < 0)
+	return -1;
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(fd, &count, sizeof(count)) != sizeof(count))
+	return -1;
+    return count;
+}
+
+/*
+ * perfctr_close - Release the counter
+ */
+void perfctr_close(int fd)
+{
+    if (fd >= 0)
+	close(fd);
+}
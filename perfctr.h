@@ -0,0 +1,15 @@
+/*
+ * perfctr.h - prototypes for the hardware event counters in perfctr.c
+ */
+
+/* Open a counter of data TLB misses for this process; -1 if unsupported */
+int perfctr_open_dtlb(void);
+
+/* Reset and enable the counter */
+void perfctr_start(int fd);
+
+/* Disable the counter and return its value; -1 on error */
+long long perfctr_stop(int fd);
+
+/* Release the counter */
+void perfctr_close(int fd);
@@ -0,0 +1,251 @@
+/*
+ * pmrbench.cc - std::pmr containers over the memory resources of mmpmr.h
+ *               and of the standard library.
+ *
+ * Runs a workload for each of vector, map, unordered_map and string over
+ * each resource and reports the throughput and the peak footprint, so the
+ * resource can be picked per container:
+ *
+ *   mm          mm_memory_resource, a dedicated mm heap
+ *   mm-arena    mm_arena_resource, monotonic over the mm heap
+ *   new-delete  std::pmr::new_delete_resource(), the libc heap
+ *   monotonic   std::pmr::monotonic_buffer_resource over new-delete
+ *
+ * A workload grows its containers by n elements while it also erases
+ * some, so a monotonic resource never gets to reuse memory. Every run is
+ * a child process of its own, so it starts from an empty heap. The peak
+ * of the mm resources is the high water mark of their heap; that of the
+ * libc ones is the memory glibc holds from the system at the end of the
+ * growth phase, above what it held when the run started, as glibc hardly
+ * ever gives memory back before that.
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <malloc.h>
+#include <map>
+#include <string>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+#include <sys/wait.h>
+
+#include "mmpmr.h"
+
+#define DEF_OPS 200000 /* Default elements added per workload (-n) */
+#define NVECTORS 64     /* Vectors in the vector workload */
+
+namespace pmr = std::pmr;
+
+static int nops = DEF_OPS;
+static unsigned int seed;
+
+static const char *resources[] = {"mm", "mm-arena", "new-delete",
+                                  "monotonic"};
+static const int nresources = sizeof(resources) / sizeof(resources[0]);
+
+/*
+ * rnd - xorshift pseudo-random numbers, the same sequence in every run
+ */
+static unsigned int rnd(void)
+{
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+/*
+ * The workloads. Each adds nops elements; peak() is called when the
+ * containers are at their largest, before they are destroyed.
+ */
+template <class Peak>
+static void vector_work(pmr::memory_resource *mr, Peak peak)
+{
+    pmr::vector<pmr::vector<int>> vs(mr);
+    int i;
+
+    for (i = 0; i < NVECTORS; i++)
+        vs.emplace_back();
+    for (i = 0; i < nops; i++) {
+        pmr::vector<int> &v = vs[rnd() % NVECTORS];
+        /* now and then a vector starts over */
+        if (rnd() % 1024 == 0)
+            pmr::vector<int>(mr).swap(v);
+        v.push_back(i);
+    }
+    peak();
+}
+
+template <class Peak>
+static void map_work(pmr::memory_resource *mr, Peak peak)
+{
+    pmr::map<int, int> m(mr);
+    int i;
+
+    for (i = 0; i < nops; i++) {
+        m[rnd() % (4 * nops)] = i;
+        if (i % 4 == 3)
+            m.erase(rnd() % (4 * nops));
+    }
+    peak();
+}
+
+template <class Peak>
+static void unordered_work(pmr::memory_resource *mr, Peak peak)
+{
+    pmr::unordered_map<int, int> m(mr);
+    int i;
+
+    for (i = 0; i < nops; i++) {
+        m[rnd() % (4 * nops)] = i;
+        if (i % 4 == 3)
+            m.erase(rnd() % (4 * nops));
+    }
+    peak();
+}
+
+template <class Peak>
+static void string_work(pmr::memory_resource *mr, Peak peak)
+{
+    pmr::vector<pmr::string> ss(mr);
+    int i, nslots = nops / 4 > 0 ? nops / 4 : 1;
+
+    ss.resize(nslots);
+    for (i = 0; i < nops; i++) {
+        pmr::string &s = ss[rnd() % nslots];
+        /* mostly appends, sometimes a new string past the small buffer */
+        if (rnd() % 4 == 0)
+            s = pmr::string(16 + rnd() % 240, 'x', mr);
+        else
+            s.append(1 + rnd() % 32, 'y');
+    }
+    peak();
+}
+
+struct workload {
+    const char *name;
+    void (*run)(pmr::memory_resource *mr, size_t *peak, size_t (*now)());
+};
+
+/* glibc footprint and mm peak readers for the peak callbacks */
+static size_t libc_base;
+static size_t libc_bytes()
+{
+    struct mallinfo2 mi = mallinfo2();
+    return mi.arena + mi.hblkhd - libc_base;
+}
+static mm_memory_resource *mm_mr;
+static size_t mm_bytes() { return mm_mr->peak_bytes(); }
+static size_t arena_bytes() { return mem_heappeak(); }
+
+#define WORKLOAD(name, fn)                                                 \
+    {name, [](pmr::memory_resource *mr, size_t *peak, size_t (*now)()) {   \
+         fn(mr, [&] { *peak = now(); });                                   \
+     }}
+
+static const workload workloads[] = {
+    WORKLOAD("vector", vector_work),
+    WORKLOAD("map", map_work),
+    WORKLOAD("unordered_map", unordered_work),
+    WORKLOAD("string", string_work),
+};
+static const int nworkloads = sizeof(workloads) / sizeof(workloads[0]);
+
+static void run(const workload *w, int res);
+static void usage(void);
+
+int main(int argc, char **argv)
+{
+    int c, i, j, status;
+    const char *only = NULL;
+    pid_t pid;
+
+    while ((c = getopt(argc, argv, "n:r:h")) != EOF) {
+        switch (c) {
+        case 'n': /* Elements per workload */
+            nops = atoi(optarg);
+            break;
+        case 'r': /* Only one resource */
+            only = optarg;
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (nops < 1) {
+        usage();
+        exit(1);
+    }
+
+    printf("%d elements per workload\n", nops);
+    printf("%-15s%-12s%10s%10s\n", "container", "resource", "Mops/s",
+           "peak KB");
+    for (i = 0; i < nworkloads; i++)
+        for (j = 0; j < nresources; j++) {
+            if (only && strcmp(only, resources[j]))
+                continue;
+            fflush(stdout);
+            if ((pid = fork()) < 0) {
+                perror("fork");
+                exit(1);
+            }
+            if (pid == 0) {
+                run(&workloads[i], j);
+                exit(0);
+            }
+            waitpid(pid, &status, 0);
+        }
+    return 0;
+}
+
+/*
+ * run - Run workload w over resource number res and print a line
+ */
+static void run(const workload *w, int res)
+{
+    std::chrono::steady_clock::time_point t0, t1;
+    size_t peak = 0;
+    double secs;
+
+    mem_init();
+    seed = 2463534242u;
+    libc_base = libc_bytes();
+    t0 = std::chrono::steady_clock::now();
+    if (!strcmp(resources[res], "mm")) {
+        mm_memory_resource mr;
+        mm_mr = &mr;
+        w->run(&mr, &peak, mm_bytes);
+    } else if (!strcmp(resources[res], "mm-arena")) {
+        mm_arena_resource mr;
+        w->run(&mr, &peak, arena_bytes);
+    } else if (!strcmp(resources[res], "new-delete")) {
+        w->run(pmr::new_delete_resource(), &peak, libc_bytes);
+    } else {
+        pmr::monotonic_buffer_resource mr(pmr::new_delete_resource());
+        w->run(&mr, &peak, libc_bytes);
+    }
+    t1 = std::chrono::steady_clock::now();
+    secs = std::chrono::duration<double>(t1 - t0).count();
+    printf("%-15s%-12s%10.2f%10zu\n", w->name, resources[res],
+           nops / secs / 1e6, peak / 1024);
+    mem_deinit();
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: pmrbench [-n <elements>] [-r <resource>]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-n <n>        Elements added per workload"
+            " (default %d).\n", DEF_OPS);
+    fprintf(stderr, "\t-r <name>     Run only mm, mm-arena, new-delete or"
+            " monotonic.\n");
+}
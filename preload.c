@@ -0,0 +1,200 @@
+/*
+ * preload.c
+ * the C allocation functions over mtcache, built with newdel.cc into
+ * libmm.so, which replaces the libc allocator of a program when put in
+ * LD_PRELOAD:
+ * 1) the first call maps the memlib heap and sets up the caches, in
+ *    per-CPU mode if glibc has registered rseq by then, else per thread.
+ *    That call comes from the startup of the program, before it can make
+ *    any threads;
+ * 2) whatever sysconf allocates while the caches are set up comes from mm
+ *    directly, and is freed again before mm_mt_init resets the heap;
+ * 3) malloc(0) returns a block of one byte, not NULL, as programs written
+ *    for glibc expect;
+ * 4) payloads are 8-byte aligned, like every mm payload; the memalign
+ *    family asks mm for stricter alignment.
+ */
+#include <errno.h>
+#include <malloc.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "memlib.h"
+#include "mm.h"
+#include "mtcache.h"
+
+/* Setup states */
+#define PL_NONE 0  /* Nothing set up yet */
+#define PL_SETUP 1 /* Caches being set up, use mm directly */
+#define PL_READY 2 /* Caches ready */
+
+/* Global variables */
+static int pl_state = PL_NONE;
+
+/* Function prototypes for internal helper routines */
+static int ready(void);
+static void setup(void);
+static int pow2(size_t align);
+
+/*
+ * malloc - Allocate a block with at least size bytes of payload
+ */
+void *malloc(size_t size) {
+  void *bp;
+
+  if (size == 0)
+    size = 1;
+  bp = ready() ? mm_mt_malloc(size) : mm_malloc(size);
+  if (bp == NULL)
+    errno = ENOMEM;
+  return bp;
+}
+
+/*
+ * free - Free a block
+ */
+void free(void *bp) {
+  if (bp == NULL)
+    return;
+  if (ready())
+    mm_mt_free(bp);
+  else
+    mm_free(bp);
+}
+
+/*
+ * calloc - Allocate a zeroed array of nmemb elements of size bytes each
+ */
+void *calloc(size_t nmemb, size_t size) {
+  size_t bytes;
+  void *bp;
+
+  if (__builtin_mul_overflow(nmemb, size, &bytes)) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  /* not through malloc, which gcc would turn malloc and memset into a
+   * call to calloc */
+  if (bytes == 0)
+    bytes = 1;
+  if ((bp = ready() ? mm_mt_malloc(bytes) : mm_malloc(bytes)) == NULL) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  memset(bp, 0, bytes);
+  return bp;
+}
+
+/*
+ * realloc - Resize a block, moving it if it has to grow
+ */
+void *realloc(void *ptr, size_t size) {
+  void *bp;
+
+  if (ptr == NULL)
+    return malloc(size);
+  bp = ready() ? mm_mt_realloc(ptr, size) : mm_realloc(ptr, size);
+  if (bp == NULL && size != 0)
+    errno = ENOMEM;
+  return bp;
+}
+
+/*
+ * memalign - Allocate a block whose payload is aligned to align, a power
+ *            of two
+ */
+void *memalign(size_t align, size_t size) {
+  void *bp;
+
+  if (!pow2(align)) {
+    errno = EINVAL;
+    return NULL;
+  }
+  if (size == 0)
+    size = 1;
+  bp = ready() ? mm_mt_memalign(align, size) : mm_memalign(align, size);
+  if (bp == NULL)
+    errno = ENOMEM;
+  return bp;
+}
+
+/*
+ * aligned_alloc - memalign under its C11 name
+ */
+void *aligned_alloc(size_t align, size_t size) {
+  return memalign(align, size);
+}
+
+/*
+ * posix_memalign - memalign that returns the error and stores the block
+ */
+int posix_memalign(void **memptr, size_t align, size_t size) {
+  void *bp;
+
+  if (!pow2(align) || align % sizeof(void *) != 0)
+    return EINVAL;
+  if ((bp = memalign(align, size)) == NULL)
+    return ENOMEM;
+  *memptr = bp;
+  return 0;
+}
+
+/*
+ * valloc - Allocate a page-aligned block
+ */
+void *valloc(size_t size) { return memalign(mem_pagesize(), size); }
+
+/*
+ * pvalloc - Allocate a page-aligned block of whole pages
+ */
+void *pvalloc(size_t size) {
+  size_t page = mem_pagesize();
+
+  if (size > (size_t)-1 - page) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  return memalign(page, (size + page - 1) & ~(page - 1));
+}
+
+/*
+ * malloc_usable_size - Bytes of payload in the block bp
+ */
+size_t malloc_usable_size(void *bp) { return mm_usable_size(bp); }
+
+/*
+ * The remaining routines are internal helper routines
+ */
+
+/*
+ * ready - Set things up on the first call; return whether the caches are
+ *         ready, or mm is to be used directly
+ */
+static int ready(void) {
+  if (__builtin_expect(pl_state == PL_READY, 1))
+    return 1;
+  if (pl_state == PL_NONE)
+    setup();
+  return pl_state == PL_READY;
+}
+
+/*
+ * setup - Map the heap and set up the caches
+ */
+static void setup(void) {
+  pl_state = PL_SETUP;
+  mem_init();
+  if (mm_mt_init(MM_MT_PERCPU) < 0) {
+    write(STDERR_FILENO, "libmm: mm_mt_init failed\n", 25);
+    abort();
+  }
+  pl_state = PL_READY;
+}
+
+/*
+ * pow2 - Whether align is a power of two
+ */
+static int pow2(size_t align) {
+  return align != 0 && (align & (align - 1)) == 0;
+}